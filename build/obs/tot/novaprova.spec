@@ -9,6 +9,7 @@ Url: http://www.novaprova.org/
 BuildRoot: /var/tmp/%{name}-root
 BuildRequires: autoconf, automake, gcc-c++ >= 4.8
 BuildRequires: valgrind-devel, binutils-devel, libxml2-devel, pkgconfig
+BuildRequires: zlib-devel
 BuildRequires: doxygen, perl-XML-LibXML
 Vendor: Greg Banks <gnb@fmeh.org>
 
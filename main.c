@@ -21,11 +21,13 @@
 #include "np/util/profile.hxx"
 #include "np/util/tok.hxx"
 #include "np/util/log.hxx"
+#include "np/spiegel/spiegel.hxx"
 
 static void
 usage(const char *argv0)
 {
     fprintf(stderr, "Usage: %s [--debug] [-f output-format] [test-spec...]\n", argv0);
+    fprintf(stderr, "       %s --write-index\n", argv0);
     exit(1);
 }
 
@@ -35,7 +37,8 @@ usage(const char *argv0)
 enum opt_codes_t
 {
     OPT_HELP=256,
-    OPT_DEBUG
+    OPT_DEBUG,
+    OPT_WRITE_INDEX
 };
 
 int
@@ -45,7 +48,7 @@ main(int argc, char **argv)
     np_plan_t *plan = 0;
     np_runner_t *runner = 0;
     const char *output_formats = 0;
-    enum { UNKNOWN, RUN, LIST } mode = UNKNOWN;
+    enum { UNKNOWN, RUN, LIST, WRITE_INDEX } mode = UNKNOWN;
     int concurrency = -1;
     bool debug = false;
     int c;
@@ -55,6 +58,7 @@ main(int argc, char **argv)
 	{ "jobs", required_argument, NULL, 'j' },
 	{ "list", no_argument, NULL, 'l' },
 	{ "debug", no_argument, NULL, OPT_DEBUG },
+	{ "write-index", no_argument, NULL, OPT_WRITE_INDEX },
 	{ "help", no_argument, NULL, OPT_HELP },
 	{ NULL, 0, NULL, 0 },
     };
@@ -79,6 +83,9 @@ main(int argc, char **argv)
         case OPT_DEBUG:
             debug = true;
             break;
+        case OPT_WRITE_INDEX:
+            mode = WRITE_INDEX;
+            break;
         case OPT_HELP:
         default:
             // note, for unknown options getopt_long() has already
@@ -94,6 +101,14 @@ main(int argc, char **argv)
     }
     np::log::basic_config(debug ? np::log::DEBUG : np::log::INFO, 0);
 
+    if (mode == WRITE_INDEX)
+    {
+	/* Write index files to speed up later runs, e.g. as
+	 * a build step after linking the test executable */
+	np::spiegel::state_t state;
+	return (state.add_self() && state.write_index_files()) ? 0 : 1;
+    }
+
     if (optind < argc)
     {
 	/* Some tests were specified on the commandline */
@@ -134,6 +149,9 @@ main(int argc, char **argv)
 	/* Run the specified tests */
 	ec = np_run_tests(runner, plan);
 	break;
+
+    case WRITE_INDEX:	/* handled above */
+	break;
     }
 
     /* Shut down the NovaProva library */
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include "np/event.hxx"
+#include "np/spiegel/platform/common.hxx"
 
 namespace np {
 using namespace std;
@@ -23,22 +24,19 @@ np::spiegel::state_t *event_t::spiegel_;
 
 event_t &event_t::with_stack()
 {
-    string trace = spiegel_->describe_stacktrace();
-    if (trace.length())
+    /* Only capture the return addresses here, which is quick
+     * and doesn't allocate.  Symbolising them is left to
+     * get_long_location(), which normally runs in the parent. */
+    static np::spiegel::addr_t stackbuf[MAX_STACK];
+    unsigned int n = np::spiegel::platform::get_stacktrace(stackbuf, MAX_STACK);
+    if (n)
     {
 	/* only clobber `function' if we have something better */
 	locflags &= ~LT__function;
 	locflags |= LT_STACK;
-
-	/* It's really really annoying that we have to do this,
-	 * but it avoids Valgrind complaining about the stack
-	 * trace string being potentially leaked.
-	 * TODO: work out why the hell Valgrind complains about
-	 * this string and not about the ones in normalise() */
-	static char tracebuf[2048];
-	strncpy(tracebuf, trace.c_str(), sizeof(tracebuf));
-	memcpy(tracebuf+sizeof(tracebuf)-5, "...\0", 4);
-	function = tracebuf;
+	function = 0;
+	stack = stackbuf;
+	nstack = n;
     }
     return *this;
 }
@@ -56,6 +54,9 @@ void
 event_t::save_strings()
 {
     size_t len = 0;
+    /* the stack goes first in the buffer, to keep it aligned */
+    if (stack)
+	len += nstack * sizeof(np::spiegel::addr_t);
     if (description)
 	len += strlen(description)+1;
     if (filename)
@@ -64,6 +65,12 @@ event_t::save_strings()
 	len += strlen(function)+1;
 
     char *p = freeme_ = (char *)np::util::xmalloc(len);
+    if (stack)
+    {
+	memcpy(p, stack, nstack * sizeof(np::spiegel::addr_t));
+	stack = (const np::spiegel::addr_t *)p;
+	p += nstack * sizeof(np::spiegel::addr_t);
+    }
     if (description)
     {
 	strcpy(p, description);
@@ -118,7 +125,8 @@ event_t::normalise(const event_t *orig)
 	if (orig->locflags & LT_STACK)
 	{
 	    this->locflags |= LT_STACK;
-	    this->function = xstr(orig->function);
+	    this->stack = orig->stack;
+	    this->nstack = orig->nstack;
 	}
     }
 }
@@ -210,7 +218,11 @@ string event_t::get_long_location() const
 	string s = "";
 	if ((locflags & (LT_FILENAME|LT_LINENO)) == (LT_FILENAME|LT_LINENO))
 	    s = get_short_location() + "\n";
-	return s + string(function);
+	if (spiegel_)
+	    return s + spiegel_->describe_stacktrace(stack, nstack);
+	for (unsigned int i = 0 ; i < nstack ; i++)
+	    s += string(i ? "by " : "at ") + HEX(stack[i]) + "\n";
+	return s;
     }
     return get_short_location() + "\n";
 }
@@ -50,7 +50,7 @@ public:
 	LT_LINENO	= (1<<1),   /* lineno */
 	LT_FUNCNAME	= (1<<2),   /* function */
 	LT_SPIEGELFUNC	= (1<<3),   /* function */
-	LT_STACK	= (1<<4),   /* function */
+	LT_STACK	= (1<<4),   /* stack, nstack */
 	LT_FUNCTYPE	= (1<<5),   /* functype */
 
 	LT__function	= (LT_FUNCNAME|LT_SPIEGELFUNC|LT_STACK)
@@ -65,6 +65,8 @@ public:
 	lineno(0),
 	function(0),
 	functype(FT_UNKNOWN),
+	nstack(0),
+	stack(0),
 	freeme_(0)
     {}
     event_t(enum events_t w,
@@ -76,6 +78,8 @@ public:
 	lineno(0),
 	function(0),
 	functype(FT_UNKNOWN),
+	nstack(0),
+	stack(0),
 	freeme_(0)
     {}
     ~event_t()
@@ -150,6 +154,11 @@ public:
     unsigned int lineno;
     const char *function;
     functype_t functype;
+    /* Raw return addresses, innermost first.  These are captured
+     * cheaply in the test child and only turned into text by the
+     * parent when the event is reported. */
+    unsigned int nstack;
+    const np::spiegel::addr_t *stack;
 
     static void init(np::spiegel::state_t *s)
     {
@@ -162,6 +171,7 @@ public:
 
 private:
 
+    enum { MAX_STACK = 256 };
     void save_strings();
     char *freeme_;
     static np::spiegel::state_t *spiegel_;
@@ -47,6 +47,14 @@ serialise_string(int fd, const char *s)
     }
 }
 
+static void
+serialise_stack(int fd, const np::spiegel::addr_t *stack, unsigned int nstack)
+{
+    serialise_uint(fd, nstack);
+    if (nstack)
+	write(fd, stack, nstack * sizeof(np::spiegel::addr_t));
+}
+
 static void
 serialise_event(int fd, const event_t *ev)
 {
@@ -57,6 +65,7 @@ serialise_event(int fd, const event_t *ev)
     serialise_uint(fd, ev->lineno);
     serialise_string(fd, ev->function);
     serialise_uint(fd, ev->functype);
+    serialise_stack(fd, ev->stack, ev->nstack);
 }
 
 static bool
@@ -109,6 +118,17 @@ deserialise_string(int fd, char **buf)
     return deserialise_bytes(fd, *buf, len+1);
 }
 
+static bool
+deserialise_stack(int fd, np::spiegel::addr_t **stackp, unsigned int *nstackp)
+{
+    if (!(deserialise_uint(fd, nstackp)))
+	return false;
+    if (!*nstackp)
+	return true;
+    *stackp = (np::spiegel::addr_t *) malloc(*nstackp * sizeof(np::spiegel::addr_t));
+    return deserialise_bytes(fd, (char *)*stackp, *nstackp * sizeof(np::spiegel::addr_t));
+}
+
 static bool
 deserialise_event(int fd, event_t *ev)
 {
@@ -119,6 +139,8 @@ deserialise_event(int fd, event_t *ev)
     char * description = NULL;
     char * filename = NULL;
     char * function = NULL;
+    np::spiegel::addr_t *stack = NULL;
+    unsigned int nstack = 0;
 
     if (!(deserialise_uint(fd, &which)))
 	return false;
@@ -134,6 +156,8 @@ deserialise_event(int fd, event_t *ev)
 	return false;
     if (!(deserialise_uint(fd, &ft)))
 	return false;
+    if (!(deserialise_stack(fd, &stack, &nstack)))
+	return false;
     ev->which = (enum events_t)which;
     ev->description = description;
     ev->locflags = locflags;
@@ -141,6 +165,8 @@ deserialise_event(int fd, event_t *ev)
     ev->filename = filename;
     ev->function = function;
     ev->functype = (functype_t)ft;
+    ev->stack = stack;
+    ev->nstack = nstack;
     return true;
 }
 
@@ -153,6 +179,8 @@ deserialise_event_cleanup(event_t *ev)
         free((void *)ev->filename);
     if (ev->function)
         free((void *)ev->function);
+    if (ev->stack)
+        free((void *)ev->stack);
 }
 
 /*-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-*/
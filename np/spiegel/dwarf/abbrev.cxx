@@ -13,31 +13,169 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <new>
 #include "abbrev.hxx"
 #include "reader.hxx"
+#include "enumerations.hxx"
+#include "np/util/log.hxx"
 
 namespace np { namespace spiegel { namespace dwarf {
 using namespace std;
+using namespace np::util;
+
+void
+abbrev_t::compute_skip_plan()
+{
+    has_sibling = false;
+    fixed_size = true;
+    nfixed_bytes = 0;
+    noffsets = 0;
+    nstrps = 0;
+
+    for (const attr_spec_t *i = attr_specs.begin() ; i != attr_specs.end() ; ++i)
+    {
+	if (i->name == DW_AT_sibling)
+	    has_sibling = true;
+	switch (i->form)
+	{
+	case DW_FORM_flag_present:
+	    break;
+	case DW_FORM_data1:
+	case DW_FORM_flag:
+	case DW_FORM_ref1:
+	    nfixed_bytes += 1;
+	    break;
+	case DW_FORM_data2:
+	case DW_FORM_ref2:
+	    nfixed_bytes += 2;
+	    break;
+	case DW_FORM_data4:
+	case DW_FORM_ref4:
+	    nfixed_bytes += 4;
+	    break;
+	case DW_FORM_data8:
+	case DW_FORM_ref8:
+	case DW_FORM_ref_sig8:
+	    nfixed_bytes += 8;
+	    break;
+	case DW_FORM_addr:
+	    nfixed_bytes += _NP_ADDRSIZE;
+	    break;
+	case DW_FORM_ref_addr:
+	case DW_FORM_sec_offset:
+	    noffsets++;
+	    break;
+	case DW_FORM_strp:
+	    nstrps++;
+	    break;
+	default:
+	    /* LEB128s, strings, blocks, and anything
+	     * we don't understand */
+	    fixed_size = false;
+	    break;
+	}
+    }
+}
 
 bool
-abbrev_t::read(reader_t &r)
+abbrev_table_t::read(reader_t &r, arena_t &arena)
 {
-    if (!r.read_uleb128(tag) ||
-	!r.read_u8(children))
-	return false;
-    for (;;)
+    dprintf("reading abbrevs at offset 0x%x\n", offset_);
+    r.seek(offset_);
+
+    /* The table is built up in these vectors, and copied
+     * into the arena once its final size is known.  The
+     * attr_specs ranges are recorded as indexes until then. */
+    vector<abbrev_t> abbrevs;
+    vector<abbrev_t::attr_spec_t> attr_specs;
+    vector<pair<size_t, size_t> > spans;
+    uint32_t code;
+    unsigned int nread = 0;
+    /* code 0 indicates end of table */
+    while (r.read_uleb128(code) && code)
     {
-	attr_spec_t as;
-	if (!r.read_uleb128(as.name) ||
-	    !r.read_uleb128(as.form))
+	abbrev_t a(code);
+	size_t first = attr_specs.size();
+	bool ok = (r.read_uleb128(a.tag) && r.read_u8(a.children));
+	while (ok)
+	{
+	    abbrev_t::attr_spec_t as;
+	    if (!r.read_uleb128(as.name) ||
+		!r.read_uleb128(as.form))
+	    {
+		ok = false;
+		break;
+	    }
+	    if (!as.name && !as.form)
+		break;	    /* name=0, form=0 indicates end
+			     * of attribute specifications */
+	    attr_specs.push_back(as);
+	}
+	if (!ok)
+	{
+	    eprintf("Failed to read abbrev code %u\n", code);
 	    return false;
-	if (!as.name && !as.form)
-	    break;	    /* name=0, form=0 indicates end
-			 * of attribute specifications */
-	attr_specs.push_back(as);
+	}
+	nread++;
+	if (code >= abbrevs.size())
+	{
+	    abbrevs.resize(code+1);
+	    spans.resize(code+1);
+	}
+	abbrevs[code] = a;
+	spans[code] = make_pair(first, attr_specs.size());
     }
+
+    nattr_specs_ = attr_specs.size();
+    attr_specs_ = (abbrev_t::attr_spec_t *)arena.alloc(nattr_specs_ * sizeof(abbrev_t::attr_spec_t));
+    if (nattr_specs_)
+	memcpy(attr_specs_, attr_specs.data(), nattr_specs_ * sizeof(abbrev_t::attr_spec_t));
+
+    nabbrevs_ = abbrevs.size();
+    abbrevs_ = (abbrev_t *)arena.alloc(nabbrevs_ * sizeof(abbrev_t));
+    for (uint32_t c = 0 ; c < nabbrevs_ ; c++)
+    {
+	abbrev_t *a = new(&abbrevs_[c]) abbrev_t(abbrevs[c]);
+	if (!a->code)
+	    continue;
+	a->attr_specs.begin_ = attr_specs_ + spans[c].first;
+	a->attr_specs.end_ = attr_specs_ + spans[c].second;
+	a->compute_skip_plan();
+    }
+
+    dprintf("Read %u abbrevs, largest code %u, %u attribute specifications\n",
+	    nread, (unsigned)(nabbrevs_ ? nabbrevs_-1 : 0),
+	    (unsigned)nattr_specs_);
     return true;
 }
 
+void
+abbrev_table_t::dump() const
+{
+    fprintf(stderr, "np: Abbrevs {\n");
+
+    for (uint32_t c = 0 ; c < nabbrevs_ ; c++)
+    {
+	const abbrev_t *a = &abbrevs_[c];
+	if (!a->code) continue;
+	fprintf(stderr, "np: Code %u\n", a->code);
+	fprintf(stderr, "np:     tag 0x%x (%s)\n", a->tag, tagnames.to_name(a->tag));
+	fprintf(stderr, "np:     children %u (%s)\n",
+		(unsigned)a->children,
+		childvals.to_name(a->children));
+	fprintf(stderr, "np:     attribute specifications {\n");
+
+	for (const abbrev_t::attr_spec_t *i = a->attr_specs.begin() ; i != a->attr_specs.end() ; ++i)
+	{
+	    fprintf(stderr, "np:         name 0x%x (%s)",
+		    i->name, attrnames.to_name(i->name));
+	    fprintf(stderr, "np:  form 0x%x (%s)\n",
+		    i->form, formvals.to_name(i->form));
+	}
+	fprintf(stderr, "np:     }\n");
+    }
+    fprintf(stderr, "np: }\n");
+}
+
 // close namespaces
 }; }; };
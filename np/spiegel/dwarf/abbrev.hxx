@@ -17,6 +17,7 @@
 #define __np_spiegel_dwarf_abbrev_hxx__ 1
 
 #include "np/spiegel/common.hxx"
+#include "np/util/arena.hxx"
 
 namespace np {
 namespace spiegel {
@@ -32,26 +33,106 @@ struct abbrev_t
 	uint32_t form;
     };
 
+    // A view onto a run of attr_spec_t stored contiguously
+    // in the owning abbrev_table_t.
+    struct attr_spec_range_t
+    {
+	const attr_spec_t *begin() const { return begin_; }
+	const attr_spec_t *end() const { return end_; }
+	size_t size() const { return end_ - begin_; }
+
+	const attr_spec_t *begin_;
+	const attr_spec_t *end_;
+    };
+
     // default c'tor
     abbrev_t()
      :  code(0),
 	tag(0),
-	children(0)
-    {}
+	children(0),
+	has_sibling(false),
+	fixed_size(false),
+	nfixed_bytes(0),
+	noffsets(0),
+	nstrps(0)
+    {
+	attr_specs.begin_ = attr_specs.end_ = 0;
+    }
 
     // c'tor with code
     abbrev_t(uint32_t c)
      :  code(c),
 	tag(0),
-	children(0)
-    {}
+	children(0),
+	has_sibling(false),
+	fixed_size(false),
+	nfixed_bytes(0),
+	noffsets(0),
+	nstrps(0)
+    {
+	attr_specs.begin_ = attr_specs.end_ = 0;
+    }
 
-    bool read(reader_t &r);
+    void compute_skip_plan();
+    // Returns the total size in bytes of the attributes of
+    // an entry using this abbrev, only valid if fixed_size.
+    uint32_t get_fixed_size(uint16_t version, uint32_t offset_size) const
+    {
+	return nfixed_bytes +
+	       noffsets * offset_size +
+	       nstrps * (version == 2 ? 4 : offset_size);
+    }
 
     uint32_t code;
     uint32_t tag;
     uint8_t children;
-    std::vector<attr_spec_t> attr_specs;
+    attr_spec_range_t attr_specs;
+
+    // The skip plan, precomputed when the abbrev is read so that
+    // walker_t can step over entries it doesn't want to decode.
+    bool has_sibling;	    // has a DW_AT_sibling attribute
+    bool fixed_size;	    // every form has a size known without reading it
+    uint32_t nfixed_bytes;  // total size of the forms of constant size
+    uint16_t noffsets;	    // number of forms sized like a section offset
+    uint16_t nstrps;	    // number of DW_FORM_strp forms, sized by version
+};
+
+/*
+ * A parsed abbreviation table from the .debug_abbrev section.
+ * Several compile units commonly share the same table (e.g. with
+ * LTO, or with many small compile units) so tables are parsed once
+ * and cached per link object by offset.  The abbrevs are stored in a
+ * flat array indexed by code and all their attribute specifications
+ * in a single contiguous array, so that lookup while walking the
+ * .debug_info section touches as little memory as possible.  Both
+ * arrays, and the table itself, live in the state_t's arena.
+ */
+class abbrev_table_t
+{
+public:
+    abbrev_table_t(uint32_t off)
+     :  offset_(off),
+	abbrevs_(0),
+	nabbrevs_(0),
+	attr_specs_(0),
+	nattr_specs_(0)
+    {}
+
+    bool read(reader_t &r, np::util::arena_t &arena);
+    void dump() const;
+
+    uint32_t get_offset() const { return offset_; }
+    const abbrev_t *get_abbrev(uint32_t code) const
+    {
+	return (code >= nabbrevs_ || !abbrevs_[code].code ? 0 : &abbrevs_[code]);
+    }
+
+private:
+    uint32_t offset_;
+    abbrev_t *abbrevs_;
+    uint32_t nabbrevs_;
+    abbrev_t::attr_spec_t *attr_specs_;
+    uint32_t nattr_specs_;
 };
 
 // close namespaces
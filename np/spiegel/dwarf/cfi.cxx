@@ -0,0 +1,614 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "np/spiegel/common.hxx"
+#include <algorithm>
+#include <map>
+#include "cfi.hxx"
+#include "enumerations.hxx"
+#include "np/util/log.hxx"
+
+namespace np { namespace spiegel { namespace dwarf {
+using namespace std;
+using namespace np::util;
+
+/* DWARF register numbers of the stack and frame pointers */
+#if defined(_NP_x86_64)
+enum { REG_BP = 6, REG_SP = 7 };
+#elif defined(_NP_x86)
+enum { REG_BP = 5, REG_SP = 4 };
+#else
+#error "Unknown architecture"
+#endif
+
+void
+cfi_table_t::clear()
+{
+    cies_.clear();
+    fdes_.clear();
+}
+
+/* Read a pointer encoded as described by @encoding, which is one
+ * of the DW_EH_PE_* values.  We only support the encodings that
+ * GNU toolchains actually emit for FDEs. */
+bool
+cfi_table_t::read_encoded(reader_t &r, uint8_t encoding,
+			  np::spiegel::addr_t &v) const
+{
+    /* the live address of the field, for pc-relative values */
+    np::spiegel::addr_t field = (np::spiegel::addr_t)(base_ + r.get_offset());
+
+    if (encoding == DW_EH_PE_omit)
+	return false;
+    switch (encoding & 0x0f)
+    {
+    case DW_EH_PE_absptr:
+	if (!r.read_addr(v))
+	    return false;
+	break;
+    case DW_EH_PE_uleb128:
+	{
+	    uint32_t u;
+	    if (!r.read_uleb128(u))
+		return false;
+	    v = u;
+	}
+	break;
+    case DW_EH_PE_udata2:
+    case DW_EH_PE_sdata2:
+	{
+	    uint16_t u;
+	    if (!r.read_u16(u))
+		return false;
+	    v = (encoding & 0x08) ? (np::spiegel::addr_t)(int16_t)u : u;
+	}
+	break;
+    case DW_EH_PE_udata4:
+    case DW_EH_PE_sdata4:
+	{
+	    uint32_t u;
+	    if (!r.read_u32(u))
+		return false;
+	    v = (encoding & 0x08) ? (np::spiegel::addr_t)(int32_t)u : u;
+	}
+	break;
+    case DW_EH_PE_udata8:
+    case DW_EH_PE_sdata8:
+	{
+	    uint64_t u;
+	    if (!r.read_u64(u))
+		return false;
+	    v = (np::spiegel::addr_t)u;
+	}
+	break;
+    case DW_EH_PE_sleb128:
+	{
+	    int32_t s;
+	    if (!r.read_sleb128(s))
+		return false;
+	    v = (np::spiegel::addr_t)s;
+	}
+	break;
+    default:
+	return false;
+    }
+
+    switch (encoding & 0x70)
+    {
+    case DW_EH_PE_absptr:
+	break;
+    case DW_EH_PE_pcrel:
+	v += field;
+	break;
+    default:
+	return false;
+    }
+    return true;
+}
+
+bool
+cfi_table_t::read_cie(reader_t &r, unsigned long offset, bool is_eh)
+{
+    offset_t length;
+    bool is64;
+    if (!r.seek(offset) || !r.read_initial_length(length, is64))
+	return false;
+    if (length > r.get_remains())
+	return false;
+    unsigned long end = r.get_offset() + length;
+    r.set_is64(is64);
+
+    cie_t cie;
+    memset(&cie, 0, sizeof(cie));
+    cie.offset = offset;
+    cie.fde_encoding = DW_EH_PE_absptr;
+
+    uint8_t version;
+    const char *augmentation;
+    if (!r.skip_offset() ||
+	!r.read_u8(version) ||
+	!r.read_string(augmentation))
+	return false;
+    if (!is_eh && version >= 4)
+    {
+	// address_size, segment_selector_size
+	if (!r.skip_u8() || !r.skip_u8())
+	    return false;
+    }
+    if (!r.read_uleb128(cie.code_align) ||
+	!r.read_sleb128(cie.data_align))
+	return false;
+    if (version == 1)
+    {
+	uint8_t ra;
+	if (!r.read_u8(ra))
+	    return false;
+	cie.ra_reg = ra;
+    }
+    else if (!r.read_uleb128(cie.ra_reg))
+	return false;
+
+    if (augmentation[0] == 'z')
+    {
+	uint32_t auglen;
+	if (!r.read_uleb128(auglen))
+	    return false;
+	unsigned long augend = r.get_offset() + auglen;
+	for (const char *a = augmentation+1 ; *a ; a++)
+	{
+	    uint8_t enc;
+	    np::spiegel::addr_t personality;
+	    if (*a == 'R')
+	    {
+		if (!r.read_u8(cie.fde_encoding))
+		    return false;
+	    }
+	    else if (*a == 'P')
+	    {
+		/* we don't care about the personality routine but
+		 * need to skip it to find any later augmentation */
+		if (!r.read_u8(enc) ||
+		    !read_encoded(r, enc & ~DW_EH_PE_indirect, personality))
+		    return false;
+	    }
+	    else if (*a == 'L')
+	    {
+		if (!r.skip_u8())
+		    return false;
+	    }
+	    else if (*a != 'S')
+	    {
+		/* unknown augmentation, but the length lets us skip it */
+		break;
+	    }
+	}
+	if (!r.seek(augend))
+	    return false;
+	cie.has_augmentation_data = true;
+    }
+    else if (augmentation[0])
+    {
+	dprintf("unknown CIE augmentation \"%s\" at offset 0x%lx\n",
+		augmentation, offset);
+	return false;
+    }
+
+    if (r.get_offset() > end)
+	return false;
+    cie.insns = base_ + r.get_offset();
+    cie.ninsns = end - r.get_offset();
+    cies_.push_back(cie);
+    return true;
+}
+
+bool
+cfi_table_t::read(const section_t &sec, bool is_eh, unsigned long slide)
+{
+    clear();
+    base_ = (const unsigned char *)sec.get_map();
+    reader_t r = sec.get_contents();
+    /* index into cies_ by section offset */
+    map<unsigned long, uint32_t> cie_index;
+
+    dprintf("reading CFI from %s\n", is_eh ? ".eh_frame" : ".debug_frame");
+    while (r.get_remains())
+    {
+	unsigned long offset = r.get_offset();
+	offset_t length;
+	bool is64;
+	if (!r.read_initial_length(length, is64))
+	    goto error;
+	if (!length)
+	    continue;	// .eh_frame terminator, or padding
+	if (length > r.get_remains())
+	    goto error;
+	unsigned long end = r.get_offset() + length;
+	unsigned long id_offset = r.get_offset();
+	r.set_is64(is64);
+
+	offset_t id;
+	if (!r.read_offset(id))
+	    goto error;
+	bool is_cie = is_eh ? (id == 0) :
+		      is64 ? (id == (offset_t)~0ULL) : (id == 0xffffffff);
+	/* In .eh_frame the CIE pointer is relative to the field,
+	 * in .debug_frame it's an offset into the section. */
+	unsigned long cie_offset = is_cie ? offset :
+				   is_eh ? id_offset - id : id;
+
+	map<unsigned long, uint32_t>::iterator ci = cie_index.find(cie_offset);
+	if (ci == cie_index.end())
+	{
+	    reader_t cr = sec.get_contents();
+	    if (!read_cie(cr, cie_offset, is_eh))
+	    {
+		dprintf("skipping CIE at offset 0x%lx\n", cie_offset);
+		r.seek(end);
+		continue;
+	    }
+	    ci = cie_index.insert(make_pair(cie_offset, (uint32_t)cies_.size()-1)).first;
+	}
+
+	if (!is_cie)
+	{
+	    const cie_t &cie = cies_[ci->second];
+	    fde_t fde;
+	    np::spiegel::addr_t range;
+	    if (!read_encoded(r, cie.fde_encoding, fde.lo) ||
+		!read_encoded(r, cie.fde_encoding & 0x0f, range))
+		goto error;
+	    if (cie.has_augmentation_data)
+	    {
+		uint32_t auglen;
+		if (!r.read_uleb128(auglen) || !r.skip(auglen))
+		    goto error;
+	    }
+	    if (r.get_offset() > end)
+		goto error;
+	    /* FDEs for functions discarded by the linker have
+	     * a zero address, and are useless */
+	    if (fde.lo && range)
+	    {
+		if (!is_eh)
+		    fde.lo += slide;
+		fde.hi = fde.lo + range;
+		fde.insns = base_ + r.get_offset();
+		fde.ninsns = end - r.get_offset();
+		fde.cie = ci->second;
+		fdes_.push_back(fde);
+	    }
+	}
+	if (!r.seek(end))
+	    goto error;
+    }
+
+    stable_sort(fdes_.begin(), fdes_.end(), compare_fdes);
+    dprintf("read %u CIEs, %u FDEs\n",
+	    (unsigned)cies_.size(), (unsigned)fdes_.size());
+    return true;
+
+error:
+    eprintf("bad CFI at offset 0x%lx in %s\n",
+	    r.get_offset(), is_eh ? ".eh_frame" : ".debug_frame");
+    clear();
+    return false;
+}
+
+const cfi_table_t::fde_t *
+cfi_table_t::find_fde(np::spiegel::addr_t pc) const
+{
+    vector<fde_t>::const_iterator i =
+	upper_bound(fdes_.begin(), fdes_.end(), pc,
+		    [](np::spiegel::addr_t a, const fde_t &f) { return a < f.lo; });
+    if (i == fdes_.begin())
+	return 0;
+    --i;
+    return (pc < i->hi ? &*i : 0);
+}
+
+namespace {
+
+/* How to recover a register in the caller's frame */
+enum rule_kind_t
+{
+    R_SAME,
+    R_UNDEFINED,
+    R_OFFSET,
+    R_VAL_OFFSET,
+    R_UNSUPPORTED
+};
+struct rule_t
+{
+    rule_kind_t kind;
+    int32_t offset;
+};
+
+/* One row of the conceptual CFI table, cut down to the
+ * registers get_stacktrace() needs. */
+struct row_t
+{
+    uint32_t cfa_reg;
+    int32_t cfa_offset;
+    bool cfa_supported;
+    rule_t ra;
+    rule_t bp;
+};
+
+enum { MAX_REMEMBERED = 8 };
+
+struct cfa_machine_t
+{
+    uint32_t code_align;
+    int32_t data_align;
+    uint32_t ra_reg;
+    np::spiegel::addr_t loc;
+    np::spiegel::addr_t pc;
+    row_t row;
+    const row_t *initial;
+    row_t remembered[MAX_REMEMBERED];
+    unsigned int nremembered;
+
+    rule_t *rule_for(uint32_t reg)
+    {
+	if (reg == ra_reg)
+	    return &row.ra;
+	if (reg == REG_BP)
+	    return &row.bp;
+	return 0;
+    }
+    void set_rule(uint32_t reg, rule_kind_t kind, int32_t offset = 0)
+    {
+	rule_t *rule = rule_for(reg);
+	if (rule)
+	{
+	    rule->kind = kind;
+	    rule->offset = offset;
+	}
+    }
+    void restore_rule(uint32_t reg)
+    {
+	rule_t *rule = rule_for(reg);
+	if (rule && initial)
+	    *rule = (rule == &row.ra ? initial->ra : initial->bp);
+    }
+
+    /* Execute call frame instructions until the location passes
+     * pc.  Returns false for malformed or unsupported programs. */
+    bool execute(const unsigned char *insns, uint32_t ninsns);
+};
+
+bool
+cfa_machine_t::execute(const unsigned char *insns, uint32_t ninsns)
+{
+    reader_t r(insns, ninsns);
+    uint8_t op;
+    while (r.read_u8(op))
+    {
+	uint32_t reg, u, delta = 0;
+	int32_t s;
+	uint8_t u8;
+	uint16_t u16;
+
+	switch (op & 0xc0)
+	{
+	case DW_CFA_advance_loc:
+	    delta = op & 0x3f;
+	    goto advance;
+	case DW_CFA_offset:
+	    if (!r.read_uleb128(u))
+		return false;
+	    set_rule(op & 0x3f, R_OFFSET, (int32_t)u * data_align);
+	    continue;
+	case DW_CFA_restore:
+	    restore_rule(op & 0x3f);
+	    continue;
+	}
+
+	switch (op)
+	{
+	case DW_CFA_nop:
+	    break;
+	case DW_CFA_advance_loc1:
+	    if (!r.read_u8(u8))
+		return false;
+	    delta = u8;
+	    goto advance;
+	case DW_CFA_advance_loc2:
+	    if (!r.read_u16(u16))
+		return false;
+	    delta = u16;
+	    goto advance;
+	case DW_CFA_advance_loc4:
+	    if (!r.read_u32(delta))
+		return false;
+	    goto advance;
+	case DW_CFA_offset_extended:
+	    if (!r.read_uleb128(reg) || !r.read_uleb128(u))
+		return false;
+	    set_rule(reg, R_OFFSET, (int32_t)u * data_align);
+	    break;
+	case DW_CFA_offset_extended_sf:
+	    if (!r.read_uleb128(reg) || !r.read_sleb128(s))
+		return false;
+	    set_rule(reg, R_OFFSET, s * data_align);
+	    break;
+	case DW_CFA_GNU_negative_offset_extended:
+	    if (!r.read_uleb128(reg) || !r.read_uleb128(u))
+		return false;
+	    set_rule(reg, R_OFFSET, -(int32_t)u * data_align);
+	    break;
+	case DW_CFA_val_offset:
+	    if (!r.read_uleb128(reg) || !r.read_uleb128(u))
+		return false;
+	    set_rule(reg, R_VAL_OFFSET, (int32_t)u * data_align);
+	    break;
+	case DW_CFA_val_offset_sf:
+	    if (!r.read_uleb128(reg) || !r.read_sleb128(s))
+		return false;
+	    set_rule(reg, R_VAL_OFFSET, s * data_align);
+	    break;
+	case DW_CFA_restore_extended:
+	    if (!r.read_uleb128(reg))
+		return false;
+	    restore_rule(reg);
+	    break;
+	case DW_CFA_undefined:
+	    if (!r.read_uleb128(reg))
+		return false;
+	    set_rule(reg, R_UNDEFINED);
+	    break;
+	case DW_CFA_same_value:
+	    if (!r.read_uleb128(reg))
+		return false;
+	    set_rule(reg, R_SAME);
+	    break;
+	case DW_CFA_register:
+	    if (!r.read_uleb128(reg) || !r.skip_uleb128())
+		return false;
+	    set_rule(reg, R_UNSUPPORTED);
+	    break;
+	case DW_CFA_remember_state:
+	    if (nremembered == MAX_REMEMBERED)
+		return false;
+	    remembered[nremembered++] = row;
+	    break;
+	case DW_CFA_restore_state:
+	    if (!nremembered)
+		return false;
+	    row = remembered[--nremembered];
+	    break;
+	case DW_CFA_def_cfa:
+	    if (!r.read_uleb128(row.cfa_reg) || !r.read_uleb128(u))
+		return false;
+	    row.cfa_offset = u;
+	    row.cfa_supported = true;
+	    break;
+	case DW_CFA_def_cfa_sf:
+	    if (!r.read_uleb128(row.cfa_reg) || !r.read_sleb128(s))
+		return false;
+	    row.cfa_offset = s * data_align;
+	    row.cfa_supported = true;
+	    break;
+	case DW_CFA_def_cfa_register:
+	    if (!r.read_uleb128(row.cfa_reg))
+		return false;
+	    break;
+	case DW_CFA_def_cfa_offset:
+	    if (!r.read_uleb128(u))
+		return false;
+	    row.cfa_offset = u;
+	    break;
+	case DW_CFA_def_cfa_offset_sf:
+	    if (!r.read_sleb128(s))
+		return false;
+	    row.cfa_offset = s * data_align;
+	    break;
+	case DW_CFA_def_cfa_expression:
+	    if (!r.read_uleb128(u) || !r.skip(u))
+		return false;
+	    row.cfa_supported = false;
+	    break;
+	case DW_CFA_expression:
+	case DW_CFA_val_expression:
+	    if (!r.read_uleb128(reg) || !r.read_uleb128(u) || !r.skip(u))
+		return false;
+	    set_rule(reg, R_UNSUPPORTED);
+	    break;
+	case DW_CFA_GNU_args_size:
+	    if (!r.skip_uleb128())
+		return false;
+	    break;
+	default:
+	    /* includes DW_CFA_set_loc, which GCC doesn't emit */
+	    return false;
+	}
+	continue;
+
+advance:
+	loc += delta * code_align;
+	if (loc > pc)
+	    return true;
+    }
+    return true;
+}
+
+// close anonymous namespace
+};
+
+bool
+cfi_table_t::unwind(np::spiegel::platform::frame_t &frame) const
+{
+    const fde_t *fde = find_fde(frame.pc);
+    if (!fde)
+	return false;
+    const cie_t &cie = cies_[fde->cie];
+
+    cfa_machine_t m;
+    memset(&m, 0, sizeof(m));
+    m.code_align = cie.code_align;
+    m.data_align = cie.data_align;
+    m.ra_reg = cie.ra_reg;
+    m.pc = frame.pc;
+    m.row.ra.kind = R_UNDEFINED;
+    m.row.bp.kind = R_SAME;
+    if (!m.execute(cie.insns, cie.ninsns))
+	return false;
+    row_t initial = m.row;
+    m.initial = &initial;
+    m.loc = fde->lo;
+    if (!m.execute(fde->insns, fde->ninsns))
+	return false;
+
+    const row_t &row = m.row;
+    if (!row.cfa_supported)
+	return false;
+    np::spiegel::addr_t cfa;
+    if (row.cfa_reg == REG_SP)
+	cfa = frame.sp + row.cfa_offset;
+    else if (row.cfa_reg == REG_BP)
+	cfa = frame.bp + row.cfa_offset;
+    else
+	return false;
+    /* Refuse to chase an implausible CFA, e.g. from a frame pointer
+     * register which is being used for something else */
+    if (cfa <= frame.sp || cfa - frame.sp > (1UL<<20))
+	return false;
+
+    np::spiegel::addr_t pc;
+    if (row.ra.kind == R_OFFSET)
+	pc = *(np::spiegel::addr_t *)(cfa + row.ra.offset);
+    else if (row.ra.kind == R_UNDEFINED)
+	pc = 0;	// the outermost frame
+    else
+	return false;
+
+    np::spiegel::addr_t bp;
+    if (row.bp.kind == R_SAME || row.bp.kind == R_UNDEFINED)
+	bp = frame.bp;
+    else if (row.bp.kind == R_OFFSET)
+	bp = *(np::spiegel::addr_t *)(cfa + row.bp.offset);
+    else if (row.bp.kind == R_VAL_OFFSET)
+	bp = cfa + row.bp.offset;
+    else
+	return false;
+
+    frame.pc = pc;
+    frame.sp = cfa;
+    frame.bp = bp;
+    return true;
+}
+
+// close namespaces
+}; }; };
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __np_spiegel_dwarf_cfi_hxx__
+#define __np_spiegel_dwarf_cfi_hxx__ 1
+
+#include "np/spiegel/common.hxx"
+#include "np/spiegel/platform/common.hxx"
+#include "section.hxx"
+#include <vector>
+
+namespace np {
+namespace spiegel {
+namespace dwarf {
+
+/*
+ * Call Frame Information for one link object, read from the
+ * .eh_frame section (or .debug_frame if there's no .eh_frame)
+ * and used to unwind stack frames of functions compiled without
+ * a frame pointer.  The table is built once in the parent, so
+ * that unwinding in a test child doesn't allocate memory.
+ */
+class cfi_table_t
+{
+public:
+    cfi_table_t() : base_(0) {}
+    ~cfi_table_t() {}
+
+    /* Parse the CIEs and FDEs in @sec.  If @is_eh the section is
+     * .eh_frame and must be mapped at its live address, otherwise
+     * it's .debug_frame and addresses are offset by @slide. */
+    bool read(const section_t &sec, bool is_eh, unsigned long slide);
+    void clear();
+    unsigned int get_nfdes() const { return fdes_.size(); }
+
+    /* Replace @frame with its caller's frame using the FDE covering
+     * @frame's pc.  Returns false if there's no such FDE or it uses
+     * rules which we can't follow, e.g. DWARF expressions. */
+    bool unwind(np::spiegel::platform::frame_t &frame) const;
+
+private:
+    struct cie_t
+    {
+	unsigned long offset;
+	uint32_t code_align;
+	int32_t data_align;
+	uint32_t ra_reg;
+	uint8_t fde_encoding;
+	bool has_augmentation_data;
+	const unsigned char *insns;
+	uint32_t ninsns;
+    };
+    struct fde_t
+    {
+	np::spiegel::addr_t lo;
+	np::spiegel::addr_t hi;
+	const unsigned char *insns;
+	uint32_t ninsns;
+	uint32_t cie;
+    };
+    static bool compare_fdes(const fde_t &a, const fde_t &b)
+    {
+	return a.lo < b.lo;
+    }
+
+    bool read_cie(reader_t &r, unsigned long offset, bool is_eh);
+    bool read_encoded(reader_t &r, uint8_t encoding,
+		      np::spiegel::addr_t &v) const;
+    const fde_t *find_fde(np::spiegel::addr_t pc) const;
+
+    /* where the section is mapped */
+    const unsigned char *base_;
+    std::vector<cie_t> cies_;
+    /* sorted by lo */
+    std::vector<fde_t> fdes_;
+};
+
+// close namespaces
+}; }; };
+
+#endif // __np_spiegel_dwarf_cfi_hxx__
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 #include "np/spiegel/common.hxx"
+#include <algorithm>
+#include <new>
 #include "state.hxx"
 #include "compile_unit.hxx"
 #include "link_object.hxx"
@@ -27,7 +29,7 @@ using namespace std;
 using namespace np::util;
 
 bool
-compile_unit_t::read_header(reader_t &r)
+compile_unit_t::read_header(reader_t &r, bool is_type_unit)
 {
     reader_ = r;
     offset_ = r.get_offset(); // sample offset of start of header
@@ -48,8 +50,9 @@ compile_unit_t::read_header(reader_t &r)
     if (version < MIN_DWARF_VERSION || version > MAX_DWARF_VERSION)
 	fatal("Bad DWARF version %u, expecting %u-%u",
 	      version, MIN_DWARF_VERSION, MAX_DWARF_VERSION);
-    if (length < (unsigned)(header_length-(is64 ? 14 : 6)/*read so far*/))
-	fatal("Bad DWARF compile unit length %llu", (unsigned long long)length);
+    if (is_type_unit && version < 4)
+	fatal("Bad DWARF type unit version %u, expecting 4", version);
+    np::spiegel::offset_t versionoff = r.get_offset() - 2;
 
     uint8_t addrsize;
     if (!r.read_u32(abbrevs_offset_) ||
@@ -57,6 +60,20 @@ compile_unit_t::read_header(reader_t &r)
 	return false;
     if (addrsize != _NP_ADDRSIZE) fatal("Bad DWARF addrsize %u, expecting %u",
 	      addrsize, _NP_ADDRSIZE);
+    if (is_type_unit)
+    {
+	uint64_t off64 = 0;
+	uint32_t off32 = 0;
+	if (!r.read_u64(type_signature_) ||
+	    !(is64 ? r.read_u64(off64) : r.read_u32(off32)))
+	    return false;
+	type_offset_ = (is64 ? off64 : off32);
+	dprintf("type unit signature 0x%llx type_offset 0x%llx\n",
+		(unsigned long long)type_signature_,
+		(unsigned long long)type_offset_);
+    }
+    if (length < r.get_offset() - versionoff)
+	fatal("Bad DWARF compile unit length %llu", (unsigned long long)length);
 
     dprintf("length %u version %u is64 %s abbrevs_offset %u addrsize %u\n",
 	    (unsigned)length,
@@ -67,8 +84,11 @@ compile_unit_t::read_header(reader_t &r)
 
     version_ = version;
     is64_ = is64;
+    is_type_unit_ = is_type_unit;
+    header_length_ = r.get_offset() - offset_;
 
     length += is64 ? 12 : 4;	// account for the `length' field of the header
+    end_offset_ = offset_ + length;
 
     // setup reader_ to point to the whole compile
     // unit but not any bytes of the next one
@@ -76,43 +96,37 @@ compile_unit_t::read_header(reader_t &r)
     reader_ = reader_.initial_subset(length);
 
     // skip the outer reader over the body
-    r.skip(length - header_length);
+    r.skip(length - header_length_);
 
     return true;
 }
 
-void
-compile_unit_t::read_abbrevs(reader_t &r)
+bool
+compile_unit_t::read_abbrevs()
 {
-    dprintf("reading abbrevs\n");
-    r.seek(abbrevs_offset_);
+    link_object_t *lo = (split_object_ ? split_object_ : link_object_);
+    abbrevs_ = lo->get_abbrev_table(abbrevs_offset_);
+    return (abbrevs_ != 0);
+}
 
-    uint32_t code;
-    unsigned int nread = 0;
-    /* code 0 indicates end of compile unit */
-    while (r.read_uleb128(code) && code)
-    {
-	abbrev_t *a = new abbrev_t(code);
-	if (!a->read(r))
-	{
-            eprintf("Failed to read abbrev code %u\n", code);
-	    delete a;
-	    break;
-	}
-        nread++;
-	if (a->code >= abbrevs_.size())
-	    abbrevs_.resize(a->code+1, 0);
-	abbrevs_[a->code] = a;
-    }
-    dprintf("Read %u abbrevs, largest code %u\n", nread, abbrevs_.size()-1);
+/* The memory for this and the line number program belongs to the
+ * state_t's arena, but their vectors need to be released. */
+compile_unit_t::~compile_unit_t()
+{
+    if (lineno_program_)
+	lineno_program_->~lineno_program_t();
 }
 
 bool
 compile_unit_t::read_lineno_program(reader_t &r)
 {
-    lineno_program_t *lp = new lineno_program_t(compilation_directory_);
+    lineno_program_t *lp = new(state_t::instance()->get_arena().alloc(sizeof(lineno_program_t)))
+			    lineno_program_t(compilation_directory_);
     if (!lp->read_header(r))
+    {
+        lp->~lineno_program_t();
         return false;
+    }
     lineno_program_ = lp;
     return true;
 }
@@ -120,31 +134,7 @@ compile_unit_t::read_lineno_program(reader_t &r)
 void
 compile_unit_t::dump_abbrevs() const
 {
-    fprintf(stderr, "np: Abbrevs {\n");
-
-    vector<abbrev_t*>::const_iterator itr;
-    for (itr = abbrevs_.begin() ; itr != abbrevs_.end() ; ++itr)
-    {
-	abbrev_t *a = *itr;
-	if (!a) continue;
-	fprintf(stderr, "np: Code %u\n", a->code);
-	fprintf(stderr, "np:     tag 0x%x (%s)\n", a->tag, tagnames.to_name(a->tag));
-	fprintf(stderr, "np:     children %u (%s)\n",
-		(unsigned)a->children,
-		childvals.to_name(a->children));
-	fprintf(stderr, "np:     attribute specifications {\n");
-
-	vector<abbrev_t::attr_spec_t>::iterator i;
-	for (i = a->attr_specs.begin() ; i != a->attr_specs.end() ; ++i)
-	{
-	    fprintf(stderr, "np:         name 0x%x (%s)",
-		    i->name, attrnames.to_name(i->name));
-	    fprintf(stderr, "np:  form 0x%x (%s)\n",
-		    i->form, formvals.to_name(i->form));
-	}
-	fprintf(stderr, "np:     }\n");
-    }
-    fprintf(stderr, "np: }\n");
+    abbrevs_->dump();
 }
 
 bool
@@ -161,21 +151,138 @@ compile_unit_t::read_attributes()
     low_pc_ = e->get_uint64_attribute(DW_AT_low_pc);
     high_pc_ = e->get_uint64_attribute(DW_AT_high_pc);
     language_ = e->get_uint32_attribute(DW_AT_language);
+    dwo_id_ = e->get_uint64_attribute(DW_AT_GNU_dwo_id);
+    addr_base_ = e->get_uint64_attribute(DW_AT_GNU_addr_base);
+    ranges_base_ = e->get_uint64_attribute(DW_AT_GNU_ranges_base);
+    // last, as it makes the split unit pending
+    dwo_name_ = e->get_string_attribute(DW_AT_GNU_dwo_name);
 
     dprintf("populated spiegel compile unit %s comp_dir %s "
-            "low_pc 0x%llx high_pc 0x%llx language %u\n",
+            "low_pc 0x%llx high_pc 0x%llx language %u dwo_name %s\n",
             filename_,
             compilation_directory_,
             (unsigned long long)low_pc_,
             (unsigned long long)high_pc_,
-            (unsigned)language_);
+            (unsigned)language_,
+            dwo_name_);
+
+    return true;
+}
+
+/* Replace the contents of a split DWARF skeleton compile unit
+ * with the split unit from its .dwo file or the .dwp package.
+ * This is done the first time the compile unit is walked, so
+ * that units which are never looked at cost only the skeleton.
+ * If the split unit can't be found, the compile unit appears
+ * to be empty. */
+bool
+compile_unit_t::load_split()
+{
+    link_object_t::split_unit_t su;
+    if (!link_object_->find_split_unit(dwo_name_, compilation_directory_,
+				       dwo_id_, su))
+    {
+	wprintf("cannot find split DWARF unit %s for %s\n",
+		dwo_name_, get_executable());
+	split_failed_ = true;
+	reader_ = reader_t();
+	return false;
+    }
+    dprintf("loading split DWARF unit 0x%llx from %s\n",
+	    (unsigned long long)dwo_id_, su.object->get_filename());
+
+    /* The offsets stay those of the skeleton in the link
+     * object's .debug_info, for find_compile_unit() */
+    np::spiegel::offset_t offset = offset_;
+    np::spiegel::offset_t end_offset = end_offset_;
+    split_object_ = su.object;
+    str_offsets_base_ = su.str_offsets_offset;
+    reader_t r = split_object_->get_section(DW_sec_info)->get_contents();
+    bool ok = r.seek(su.info_offset) && read_header(r);
+    offset_ = offset;
+    end_offset_ = end_offset;
+    if (ok)
+    {
+	abbrevs_offset_ += su.abbrev_offset;
+	ok = read_abbrevs();
+    }
+    if (!ok)
+    {
+	eprintf("bad split DWARF unit %s in %s\n",
+		dwo_name_, su.object->get_filename());
+	split_object_ = 0;
+	split_failed_ = true;
+	reader_ = reader_t();
+	return false;
+    }
 
+    /* The split unit's DW_TAG_compile_unit has the attributes
+     * which the skeleton's lacks */
+    walker_t w(make_root_reference());
+    const entry_t *e = w.move_next();
+    if (e)
+    {
+	if (!filename_)
+	    filename_ = e->get_string_attribute(DW_AT_name);
+	if (!language_)
+	    language_ = e->get_uint32_attribute(DW_AT_language);
+    }
     return true;
 }
 
+/* Walk every entry in the compile unit once, recording the
+ * offset of each entry's parent.  Entries are visited in
+ * preorder, so the vector ends up sorted by offset and the
+ * most recent entry seen at each level is the parent of
+ * everything at the next level down. */
+void
+compile_unit_t::build_parent_index()
+{
+    vector<die_parent_t> parents;
+    vector<uint32_t> ancestors;
+    walker_t w(this);
+    for (const entry_t *e = w.move_preorder() ; e ; e = w.move_preorder())
+    {
+	unsigned level = e->get_level();
+	ancestors.resize(level);
+	die_parent_t dp;
+	dp.offset = e->get_offset();
+	dp.parent = level ? ancestors[level-1] : 0;
+	parents.push_back(dp);
+	ancestors.push_back(dp.offset);
+    }
+
+    nparents_ = parents.size();
+    parents_ = (die_parent_t *)state_t::instance()->get_arena().alloc(
+				    nparents_ * sizeof(die_parent_t));
+    if (nparents_)
+	memcpy(parents_, parents.data(), nparents_ * sizeof(die_parent_t));
+    dprintf("indexed %u entries in compile unit %u\n", nparents_, index_);
+}
+
+static bool
+compare_die_offsets(const compile_unit_t::die_parent_t &dp, uint32_t off)
+{
+    return dp.offset < off;
+}
+
+uint32_t
+compile_unit_t::get_parent_offset(uint32_t off)
+{
+    if (!parents_)
+	build_parent_index();
+    const die_parent_t *end = parents_ + nparents_;
+    const die_parent_t *i = lower_bound((const die_parent_t *)parents_, end,
+					 off, compare_die_offsets);
+    if (i == end || i->offset != off)
+	return 0;
+    return i->parent;
+}
+
 filename_t
 compile_unit_t::get_absolute_path() const
 {
+    ensure_split();
     return filename_t(filename_).make_absolute_to_dir(filename_t(compilation_directory_));
 }
 
@@ -188,9 +295,43 @@ compile_unit_t::get_executable() const
 const section_t *
 compile_unit_t::get_section(uint32_t i) const
 {
+    /* A split unit's own sections are in the .dwo or .dwp, but
+     * addresses, ranges and line numbers stay in the link object */
+    if (split_object_)
+    {
+	switch (i)
+	{
+	case DW_sec_info:
+	case DW_sec_abbrev:
+	case DW_sec_str:
+	case DW_sec_str_offsets:
+	case DW_sec_loc:
+	    return split_object_->get_section(i);
+	}
+    }
     return link_object_->get_section(i);
 }
 
+bool
+compile_unit_t::get_indexed_address(uint32_t idx, np::spiegel::addr_t &v) const
+{
+    reader_t r = get_section(DW_sec_addr)->get_contents();
+    return r.seek(addr_base_ + (uint64_t)idx * _NP_ADDRSIZE) &&
+	   r.read_addr(v);
+}
+
+const char *
+compile_unit_t::get_indexed_string(uint32_t idx) const
+{
+    reader_t r = get_section(DW_sec_str_offsets)->get_contents();
+    r.set_is64(is64_);
+    np::spiegel::offset_t off;
+    if (!r.seek(str_offsets_base_ + (uint64_t)idx * get_offset_size()) ||
+	!r.read_offset(off))
+	return 0;
+    return get_section(DW_sec_str)->offset_as_string(off);
+}
+
 np::spiegel::addr_t
 compile_unit_t::live_address(np::spiegel::addr_t addr) const
 {
@@ -220,5 +361,13 @@ compile_unit_t::get_source_line(
     return lineno_program_->get_source_line(addr, filenamep, linep, columnp);
 }
 
+np::util::filename_t
+compile_unit_t::get_source_filename(uint32_t file)
+{
+    if (!lineno_program_)
+        return np::util::filename_t();
+    return lineno_program_->get_filename(file);
+}
+
 // close namespaces
 }; }; };
@@ -19,24 +19,25 @@
 #include "np/spiegel/common.hxx"
 #include "reference.hxx"
 #include "reader.hxx"
+#include "abbrev.hxx"
 #include "np/util/filename.hxx"
 
 namespace np {
 namespace spiegel {
 namespace dwarf {
 
-struct abbrev_t;
 class walker_t;
 struct section_t;
 class link_object_t;
 class lineno_program_t;
 
-class compile_unit_t : public reference_resolver_t, public np::util::zalloc
+// compile_unit_t objects are placement-new'd into zeroed memory
+// from the state_t's arena, so members not set in the c'tor start
+// out as zero.
+class compile_unit_t : public reference_resolver_t
 {
 private:
     enum {
-	header_length = 11,	// this might depend on version
-
 	MIN_DWARF_VERSION = 2,
 	MAX_DWARF_VERSION = 4
     };
@@ -46,26 +47,46 @@ public:
         link_object_(lo)
     {}
 
-    ~compile_unit_t()
-    {}
+    ~compile_unit_t();
 
-    bool read_header(reader_t &r);
-    void read_abbrevs(reader_t &r);
+    // If @is_type_unit, the header is that of a DWARF 4 type
+    // unit in .debug_types, which has the type's signature
+    bool read_header(reader_t &r, bool is_type_unit = false);
+    bool read_abbrevs();
     bool read_lineno_program(reader_t &r);
     void dump_abbrevs() const;
     bool read_attributes();
+    // true for a split DWARF skeleton whose split unit
+    // hasn't been loaded yet
+    bool is_split_pending() const
+    {
+	return dwo_name_ && !split_object_ && !split_failed_;
+    }
+    bool load_split();
 
     uint32_t get_index() const { return index_; }
     void *get_upper() const { return upper_; }
     void set_upper(void *u) { upper_ = u; }
     link_object_t *get_link_object() const { return link_object_; }
+    // whether the state_t's address index has this unit's functions
+    bool is_indexed() const { return indexed_; }
+    void set_indexed(bool b) { indexed_ = b; }
     // return the file offset of the first byte of the compile unit on the disk
     np::spiegel::offset_t get_start_offset() const { return offset_; }
     // return the file offset one byte beyond the last byte of the compile unit on the disk
-    np::spiegel::offset_t get_end_offset() const { return offset_ + reader_.get_length(); }
+    np::spiegel::offset_t get_end_offset() const { return end_offset_; }
     const char *get_executable() const;
     const section_t *get_section(uint32_t) const;
     uint16_t get_version() const { return version_; }
+    bool is_type_unit() const { return is_type_unit_; }
+    uint64_t get_type_signature() const { return type_signature_; }
+    // reference to the type unit's type DIE
+    reference_t make_type_reference() const
+    {
+        return reference_t::make(this, type_offset_);
+    }
+    // size in bytes of section offsets, e.g. DW_FORM_sec_offset
+    uint32_t get_offset_size() const { return is64_ ? 8 : 4; }
     np::spiegel::addr_t live_address(np::spiegel::addr_t addr) const;
 
     reference_t make_reference(uint32_t off) const
@@ -74,7 +95,7 @@ public:
     }
     reference_t make_root_reference() const
     {
-        return reference_t::make(this, header_length);
+        return reference_t::make(this, header_length_);
     }
 
     compile_unit_offset_tuple_t resolve_reference(const reference_t &ref) const override;
@@ -82,42 +103,90 @@ public:
 
     reader_t get_contents() const
     {
+	ensure_split();
 	reader_t r = reader_;
-	r.skip(header_length);
+	r.skip(header_length_);
 	return r;
     }
 
     const abbrev_t *get_abbrev(uint32_t code) const
     {
-	return (code >= abbrevs_.size() ? 0 : abbrevs_[code]);
+	return abbrevs_->get_abbrev(code);
     }
 
     bool get_source_line(np::spiegel::addr_t addr,
                          /*out*/np::util::filename_t *filenamep,
                          /*out*/uint32_t *linep, /*out*/uint32_t *columnp);
+    // absolute name of a file in the line number program's file
+    // table, e.g. from a DW_AT_decl_file or DW_AT_call_file
+    np::util::filename_t get_source_filename(uint32_t file);
 
-    np::util::filename_t get_filename() const { return filename_; }
+    np::util::filename_t get_filename() const { ensure_split(); return filename_; }
     np::util::filename_t get_compilation_directory() const { return compilation_directory_; }
     np::util::filename_t get_absolute_path() const;
-    uint32_t get_language() const { return language_; }
+    uint32_t get_language() const { ensure_split(); return language_; }
+    // the base address for DW_AT_ranges lists
+    uint64_t get_low_pc() const { return low_pc_; }
+    // added to DW_AT_ranges values in a split unit
+    uint64_t get_ranges_base() const { return ranges_base_; }
+    // values of DW_FORM_GNU_addr_index and DW_FORM_GNU_str_index
+    bool get_indexed_address(uint32_t idx, np::spiegel::addr_t &v) const;
+    const char *get_indexed_string(uint32_t idx) const;
+
+    // return the offset of the parent of the entry at offset
+    // @off, or 0 if it's the top level entry or not found
+    uint32_t get_parent_offset(uint32_t off);
+    struct die_parent_t
+    {
+	uint32_t offset;
+	uint32_t parent;
+    };
+
 private:
+    void build_parent_index();
+    void ensure_split() const
+    {
+	if (is_split_pending())
+	    const_cast<compile_unit_t*>(this)->load_split();
+    }
+
     uint32_t index_;
     link_object_t *link_object_;
     void *upper_;
+    bool indexed_;
     uint16_t version_;
     bool is64_;		    // new 64b format introduced in DWARF3
+    uint8_t header_length_;
+    bool is_type_unit_;
+    uint64_t type_signature_;
+    np::spiegel::offset_t type_offset_;
     reader_t reader_;	    // for whole including header
     np::spiegel::offset_t offset_;
+    np::spiegel::offset_t end_offset_;
     uint32_t abbrevs_offset_;
-    std::vector<abbrev_t*> abbrevs_;
+    const abbrev_table_t *abbrevs_;	// shared, owned by the link_object_t
     // from attributes of DW_TAG_compile_unit
     const char *filename_;
     const char *compilation_directory_;
     uint64_t low_pc_;	    // TODO: should be an addr_t
     uint64_t high_pc_;
     uint32_t language_;
+    // split DWARF: the skeleton's attributes name a .dwo file
+    // holding the real unit, which replaces the skeleton's
+    // contents when it's first needed
+    const char *dwo_name_;
+    uint64_t dwo_id_;
+    uint64_t addr_base_;
+    uint64_t ranges_base_;
+    uint64_t str_offsets_base_;	// contribution in a .dwp
+    link_object_t *split_object_;
+    bool split_failed_;
     // from .debug_line section
     lineno_program_t *lineno_program_;
+    // every entry with its parent, in offset order; built
+    // on first use and stored in the state_t's arena
+    die_parent_t *parents_;
+    uint32_t nparents_;
 };
 
 // close namespaces
@@ -15,10 +15,14 @@
  */
 #include "entry.hxx"
 #include "enumerations.hxx"
+#include "compile_unit.hxx"
+#include "link_object.hxx"
+#include "state.hxx"
 #include "np/util/log.hxx"
 
 namespace np { namespace spiegel { namespace dwarf {
 using namespace std;
+using namespace np::util;
 
 /* Sometimes, in DWARF-4, the form used to store an attribute
  * impacts its semantics.  For example, DW_AT_high_pc is either
@@ -27,13 +31,251 @@ using namespace std;
 enum form_values
 entry_t::get_attribute_form(uint32_t name) const
 {
-    vector<abbrev_t::attr_spec_t>::const_iterator i;
-    for (i = abbrev_->attr_specs.begin() ; i != abbrev_->attr_specs.end() ; ++i)
+    int i = name_to_index(name);
+    if (i < 0 || generation_[i] != latest_)
+	return (enum form_values)0;
+    return (enum form_values)forms_[i];
+}
+
+/* Decode the value of the attribute with index @i from the
+ * compile unit, storing it in values_[i].  Returns false if
+ * the value couldn't be decoded. */
+bool
+entry_t::decode_attribute(int i) const
+{
+    reader_t r = compile_unit_->get_contents();
+    if (!r.seek(offsets_[i]))
+	return false;
+
+    value_t &val = values_[i];
+    switch (forms_[i])
     {
-	if (i->name == name)
-	    return (enum form_values)i->form;
+    case DW_FORM_data1:
+    case DW_FORM_flag:
+	{
+	    uint8_t v;
+	    if (!r.read_u8(v))
+		return false;
+	    val = value_t::make_uint32(v);
+	    break;
+	}
+    case DW_FORM_data2:
+	{
+	    uint16_t v;
+	    if (!r.read_u16(v))
+		return false;
+	    val = value_t::make_uint32(v);
+	    break;
+	}
+    case DW_FORM_data4:
+	{
+	    uint32_t v;
+	    if (!r.read_u32(v))
+		return false;
+	    val = value_t::make_uint32(v);
+	    break;
+	}
+    case DW_FORM_data8:
+	{
+	    uint64_t v;
+	    if (!r.read_u64(v))
+		return false;
+	    val = value_t::make_uint64(v);
+	    break;
+	}
+    case DW_FORM_ref_sig8:
+	{
+	    // The 64bit signature of a type unit, which we
+	    // resolve now to a reference into that type unit
+	    uint64_t v;
+	    if (!r.read_u64(v))
+		return false;
+	    val = value_t::make_ref(state_t::instance()->resolve_signature(v));
+	    break;
+	}
+    case DW_FORM_udata:
+	{
+	    uint32_t v;
+	    if (!r.read_uleb128(v))
+		return false;
+	    val = value_t::make_uint32(v);
+	    break;
+	}
+    case DW_FORM_sdata:
+	{
+	    int32_t v;
+	    if (!r.read_sleb128(v))
+		return false;
+	    val = value_t::make_sint32(v);
+	    break;
+	}
+    case DW_FORM_addr:
+	{
+	    np::spiegel::addr_t v;
+	    if (!r.read_addr(v))
+		return false;
+	    val = value_t::make_addr(v);
+	    break;
+	}
+    case DW_FORM_ref1:
+	{
+	    uint8_t off;
+	    if (!r.read_u8(off))
+		return false;
+	    val = value_t::make_ref(compile_unit_->make_reference(off));
+	    break;
+	}
+    case DW_FORM_ref2:
+	{
+	    uint16_t off;
+	    if (!r.read_u16(off))
+		return false;
+	    val = value_t::make_ref(compile_unit_->make_reference(off));
+	    break;
+	}
+    case DW_FORM_ref4:
+	{
+	    uint32_t off;
+	    if (!r.read_u32(off))
+		return false;
+	    val = value_t::make_ref(compile_unit_->make_reference(off));
+	    break;
+	}
+    case DW_FORM_ref8:
+	{
+	    uint64_t off;
+	    if (!r.read_u64(off))
+		return false;
+	    // TODO: detect truncation
+	    val = value_t::make_ref(compile_unit_->make_reference(off));
+	    break;
+	}
+    case DW_FORM_ref_addr:
+	{
+	    // Note that DW_FORM_ref_addr is poorly named in the
+	    // standard, it's actually encoded as a file offset
+	    // which will be 4B or 8B depending on the file format
+	    np::spiegel::offset_t off = 0;
+	    if (!r.read_offset(off))
+		return false;
+	    val = value_t::make_ref(compile_unit_->get_link_object()->make_reference(off));
+	    break;
+	}
+    case DW_FORM_string:
+	{
+	    const char *v;
+	    if (!r.read_string(v))
+		return false;
+	    val = value_t::make_string(v);
+	    break;
+	}
+    case DW_FORM_strp:
+	{
+	    np::spiegel::offset_t off;
+	    if (compile_unit_->get_version() == 2)
+	    {
+		uint32_t o32;
+		if (!r.read_u32(o32))
+		    return false;
+		off = o32;
+	    }
+	    else
+	    {
+		if (!r.read_offset(off))
+		    return false;
+	    }
+	    const char *v = compile_unit_->get_section(DW_sec_str)->offset_as_string(off);
+	    if (!v)
+		return false;
+	    val = value_t::make_string(v);
+	    break;
+	}
+    case DW_FORM_block1:
+	{
+	    uint8_t len;
+	    const unsigned char *v;
+	    if (!r.read_u8(len) ||
+		!r.read_bytes(v, len))
+		return false;
+	    val = value_t::make_bytes(v, len);
+	    break;
+	}
+    case DW_FORM_block2:
+	{
+	    uint16_t len;
+	    const unsigned char *v;
+	    if (!r.read_u16(len) ||
+		!r.read_bytes(v, len))
+		return false;
+	    val = value_t::make_bytes(v, len);
+	    break;
+	}
+    case DW_FORM_block4:
+	{
+	    uint32_t len;
+	    const unsigned char *v;
+	    if (!r.read_u32(len) ||
+		!r.read_bytes(v, len))
+		return false;
+	    val = value_t::make_bytes(v, len);
+	    break;
+	}
+    case DW_FORM_block:
+    case DW_FORM_exprloc:
+	{
+	    uint32_t len;
+	    const unsigned char *v;
+	    if (!r.read_uleb128(len) ||
+		!r.read_bytes(v, len))
+		return false;
+	    val = value_t::make_bytes(v, len);
+	    break;
+	}
+    case DW_FORM_sec_offset:
+	{
+	    np::spiegel::offset_t v;
+	    if (!r.read_offset(v))
+		return false;
+	    val = value_t::make_offset(v);
+	    break;
+	}
+    case DW_FORM_GNU_addr_index:
+	{
+	    /* an index into the link object's .debug_addr */
+	    uint32_t idx;
+	    np::spiegel::addr_t v;
+	    if (!r.read_uleb128(idx) ||
+		!compile_unit_->get_indexed_address(idx, v))
+		return false;
+	    val = value_t::make_addr(v);
+	    break;
+	}
+    case DW_FORM_GNU_str_index:
+	{
+	    /* an index into the split unit's .debug_str_offsets */
+	    uint32_t idx;
+	    if (!r.read_uleb128(idx))
+		return false;
+	    const char *v = compile_unit_->get_indexed_string(idx);
+	    if (!v)
+		return false;
+	    val = value_t::make_string(v);
+	    break;
+	}
+    case DW_FORM_flag_present:
+	/* This form has no representation in the attribute
+	 * stream, it's always true.  Presumably this is
+	 * useful in combination with a careful choice of
+	 * abbrevs. */
+	val = value_t::make_uint32(true);
+	break;
+    default:
+	// TODO: bad DWARF info - throw an exception
+	fatal("Can't handle %s at %s:%d\n",
+	      formvals.to_name(forms_[i]), __FILE__, __LINE__);
     }
-    return (enum form_values)0;
+    decoded_[i] = latest_;
+    return true;
 }
 
 string
@@ -51,7 +293,7 @@ entry_t::to_string() const
     ret += buf;
 
     const char *sep = "";
-    vector<abbrev_t::attr_spec_t>::const_iterator i;
+    const abbrev_t::attr_spec_t *i;
     for (i = abbrev_->attr_specs.begin() ; i != abbrev_->attr_specs.end() ; ++i)
     {
         ret += sep;
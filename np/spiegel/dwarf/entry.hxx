@@ -26,7 +26,16 @@ namespace spiegel {
 namespace dwarf {
 
 struct abbrev_t;
+class compile_unit_t;
 
+/*
+ * An entry_t describes the DIE a walker_t is currently positioned
+ * at.  Reading an entry only records where in the compile unit each
+ * of its attributes is stored; an attribute's value is decoded the
+ * first time it is asked for with get_attribute().  Most callers want
+ * only one or two attributes of each entry, so this avoids a lot of
+ * work decoding strings, blocks and references nobody looks at.
+ */
 class entry_t
 {
 public:
@@ -34,43 +43,55 @@ public:
      :  offset_(0),
 	level_(0),
 	abbrev_(0),
-	latest_(0)
+	compile_unit_(0),
+	latest_(1)	// so that no attributes are present
     {
 	memset(generation_, 0x0, sizeof(generation_));
+	memset(decoded_, 0x0, sizeof(decoded_));
     }
 
-    void setup(size_t offset, unsigned level, const abbrev_t *a)
+    void setup(size_t offset, unsigned level, const abbrev_t *a,
+	       const compile_unit_t *cu)
     {
 	offset_ = offset;
 	level_ = level;
 	abbrev_ = a;
+	compile_unit_ = cu;
 	latest_++;
     }
+    // The partial_setup() variants leave the entry with no
+    // attributes, so bump the generation to hide stale ones.
     void partial_setup(const entry_t &o)
     {
 	offset_ = o.offset_;
 	level_ = o.level_;
 	abbrev_ = 0;
+	latest_++;
     }
     void partial_setup(uint32_t off, uint32_t lev)
     {
 	offset_ = off;
 	level_ = lev;
 	abbrev_ = 0;
+	latest_++;
     }
     void partial_setup(uint32_t off, uint32_t lev, const abbrev_t *a)
     {
 	offset_ = off;
 	level_ = lev;
 	abbrev_ = a;
+	latest_++;
     }
 
-    void add_attribute(uint32_t name, const value_t &val)
+    // Record that the attribute @name is stored in
+    // @form at compile unit offset @off.
+    void add_attribute(uint32_t name, uint32_t form, uint32_t off)
     {
 	int i = name_to_index(name);
 	if (i < 0)
 	    return;	// silently ignore this
-	values_[i] = val;
+	forms_[i] = form;
+	offsets_[i] = off;
 	generation_[i] = latest_;
     }
 
@@ -84,7 +105,11 @@ public:
     const value_t *get_attribute(uint32_t name) const
     {
 	int i = name_to_index(name);
-	return (i >= 0 && generation_[i] == latest_ ? &values_[i] : 0);
+	if (i < 0 || generation_[i] != latest_)
+	    return 0;
+	if (decoded_[i] != latest_ && !decode_attribute(i))
+	    return 0;
+	return &values_[i];
     }
     const char *get_string_attribute(uint32_t name) const
     {
@@ -138,7 +163,8 @@ private:
 	// we oversupply space, because entry_t is never
 	// allocated and stored but handling a sparse mapping
 	// was taking up too many cycles.
-	MAX_VALUES = DW_AT_max_basic + (DW_AT_max_user - DW_AT_lo_user)
+	MAX_USER_VALUES = DW_AT_max_basic + (DW_AT_max_user - DW_AT_lo_user),
+	MAX_VALUES = MAX_USER_VALUES + (DW_AT_max_gnu_split - DW_AT_GNU_dwo_name)
     };
     static int name_to_index(int name)
     {
@@ -146,16 +172,25 @@ private:
 	    return name;
 	else if (name >= DW_AT_lo_user && name < DW_AT_max_user)
 	    return DW_AT_max_basic+name-DW_AT_lo_user;
+	else if (name >= DW_AT_GNU_dwo_name && name < DW_AT_max_gnu_split)
+	    return MAX_USER_VALUES+name-DW_AT_GNU_dwo_name;
 	else
 	    return -1;
     }
+    bool decode_attribute(int i) const;
 
     unsigned offset_;
     unsigned level_;
     const abbrev_t *abbrev_;
+    const compile_unit_t *compile_unit_;
     uint32_t latest_;
+    // generation_[i] == latest_ iff attribute i is present
     uint32_t generation_[MAX_VALUES];
-    value_t values_[MAX_VALUES];
+    uint32_t forms_[MAX_VALUES];
+    uint32_t offsets_[MAX_VALUES];
+    // decoded_[i] == latest_ iff values_[i] has been decoded
+    mutable uint32_t decoded_[MAX_VALUES];
+    mutable value_t values_[MAX_VALUES];
 };
 
 
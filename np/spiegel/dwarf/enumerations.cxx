@@ -21,7 +21,8 @@ using namespace std;
 static const char * const _secnames[DW_sec_num+1] = {
     ".debug_aranges", ".debug_pubnames", ".debug_info",
     ".debug_abbrev", ".debug_line", ".debug_frame",
-    ".debug_str", ".debug_loc", ".debug_ranges", 0
+    ".debug_str", ".debug_loc", ".debug_ranges", ".debug_types",
+    ".debug_addr", ".debug_str_offsets", ".debug_cu_index", 0
 };
 string_table_t secnames("", _secnames);
 
@@ -33,6 +33,14 @@ enum section_names
     DW_sec_str,
     DW_sec_loc,
     DW_sec_ranges,
+    /* DWARF 4 type units */
+    DW_sec_types,
+    /* Used by split DWARF.  In a .dwo or .dwp file
+     * the sections have a .dwo suffix, e.g. the
+     * .debug_info.dwo section is DW_sec_info */
+    DW_sec_addr,
+    DW_sec_str_offsets,
+    DW_sec_cu_index,
 
     DW_sec_num
 };
@@ -70,7 +78,10 @@ enum form_values
     DW_FORM_sec_offset = 0x17,
     DW_FORM_exprloc = 0x18,
     DW_FORM_flag_present = 0x19,
-    DW_FORM_ref_sig8 = 0x20
+    DW_FORM_ref_sig8 = 0x20,
+    /* GNU extensions for split DWARF in DWARF-4 */
+    DW_FORM_GNU_addr_index = 0x1f01,
+    DW_FORM_GNU_str_index = 0x1f02
 };
 
 enum tag_names
@@ -255,6 +266,17 @@ enum attribute_names
     // DW_AT_gnu_all_call_sites = 0x2117,
 
     DW_AT_max_user,
+
+    // GNU extensions for split DWARF in DWARF-4,
+    // used in the skeleton compile unit
+    DW_AT_GNU_dwo_name = 0x2130,
+    DW_AT_GNU_dwo_id = 0x2131,
+    DW_AT_GNU_ranges_base = 0x2132,
+    DW_AT_GNU_addr_base = 0x2133,
+    DW_AT_GNU_pubnames = 0x2134,
+    DW_AT_GNU_pubtypes = 0x2135,
+
+    DW_AT_max_gnu_split,
     DW_AT_hi_user = 0x3fff
 
 };
@@ -304,6 +326,76 @@ enum lineno_extended_opcodes
     DW_LNE_set_discriminator = 0x04
 };
 
+enum call_frame_instructions
+{
+    // Defined in DWARF2; the first three carry
+    // an operand in the low 6 bits of the opcode
+    DW_CFA_advance_loc = 0x40,
+    DW_CFA_offset = 0x80,
+    DW_CFA_restore = 0xc0,
+    DW_CFA_nop = 0x00,
+    DW_CFA_set_loc = 0x01,
+    DW_CFA_advance_loc1 = 0x02,
+    DW_CFA_advance_loc2 = 0x03,
+    DW_CFA_advance_loc4 = 0x04,
+    DW_CFA_offset_extended = 0x05,
+    DW_CFA_restore_extended = 0x06,
+    DW_CFA_undefined = 0x07,
+    DW_CFA_same_value = 0x08,
+    DW_CFA_register = 0x09,
+    DW_CFA_remember_state = 0x0a,
+    DW_CFA_restore_state = 0x0b,
+    DW_CFA_def_cfa = 0x0c,
+    DW_CFA_def_cfa_register = 0x0d,
+    DW_CFA_def_cfa_offset = 0x0e,
+    // Defined in DWARF3
+    DW_CFA_def_cfa_expression = 0x0f,
+    DW_CFA_expression = 0x10,
+    DW_CFA_offset_extended_sf = 0x11,
+    DW_CFA_def_cfa_sf = 0x12,
+    DW_CFA_def_cfa_offset_sf = 0x13,
+    DW_CFA_val_offset = 0x14,
+    DW_CFA_val_offset_sf = 0x15,
+    DW_CFA_val_expression = 0x16,
+    // GNU extensions
+    DW_CFA_GNU_args_size = 0x2e,
+    DW_CFA_GNU_negative_offset_extended = 0x2f
+};
+
+enum dwp_section_ids
+{
+    /* Column identifiers in the .debug_cu_index section
+     * of a .dwp package, from the DWARF-5 standard */
+    DW_SECT_INFO = 1,
+    DW_SECT_TYPES = 2,
+    DW_SECT_ABBREV = 3,
+    DW_SECT_LINE = 4,
+    DW_SECT_LOC = 5,
+    DW_SECT_STR_OFFSETS = 6,
+    DW_SECT_MACINFO = 7,
+    DW_SECT_MACRO = 8
+};
+
+enum eh_pointer_encodings
+{
+    /* Not defined in the DWARF standard but by the
+     * LSB, for pointers in .eh_frame.  The low nybble
+     * is the format and the high nybble the application */
+    DW_EH_PE_absptr = 0x00,
+    DW_EH_PE_uleb128 = 0x01,
+    DW_EH_PE_udata2 = 0x02,
+    DW_EH_PE_udata4 = 0x03,
+    DW_EH_PE_udata8 = 0x04,
+    DW_EH_PE_sleb128 = 0x09,
+    DW_EH_PE_sdata2 = 0x0a,
+    DW_EH_PE_sdata4 = 0x0b,
+    DW_EH_PE_sdata8 = 0x0c,
+    DW_EH_PE_pcrel = 0x10,
+    DW_EH_PE_datarel = 0x30,
+    DW_EH_PE_indirect = 0x80,
+    DW_EH_PE_omit = 0xff
+};
+
 namespace np {
 namespace spiegel {
 namespace dwarf {
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "np/spiegel/common.hxx"
+#include "index_file.hxx"
+#include "np/util/log.hxx"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+namespace np { namespace spiegel { namespace dwarf {
+using namespace std;
+using namespace np::util;
+
+const char index_file_t::magic[8] = { 'N', 'P', 'I', 'N', 'D', 'E', 'X', 0 };
+
+static inline uint64_t
+pad8(uint64_t x)
+{
+    return (x + 7) & ~(uint64_t)7;
+}
+
+string
+index_file_t::filename_for(const char *object)
+{
+    return string(object) + ".np-index";
+}
+
+/* Identifies the contents of @object: its @build_id if it has
+ * one, else its size and modification time. */
+string
+index_file_t::get_key(const char *object, const string &build_id)
+{
+    if (build_id.length())
+	return string("B") + build_id;
+    struct stat sb;
+    if (stat(object, &sb) < 0)
+	return string();
+    char buf[64];
+    snprintf(buf, sizeof(buf), "S%llu:%llu",
+	     (unsigned long long)sb.st_size,
+	     (unsigned long long)sb.st_mtime);
+    return string(buf);
+}
+
+void
+index_file_t::write_index(FILE *fp, const index_t &index)
+{
+    unsigned n = index.size();
+    fwrite(index.get_los(), sizeof(uint64_t), n, fp);
+    fwrite(index.get_his(), sizeof(uint64_t), n, fp);
+    fwrite(index.get_maxhis(), sizeof(uint64_t), n, fp);
+    fwrite(index.get_values(), sizeof(uint64_t), n, fp);
+}
+
+bool
+index_file_t::write(const char *object, const string &build_id,
+		    uint64_t info_size,
+		    const vector<uint64_t> &cu_offsets,
+		    const index_t &functions,
+		    const index_t &inlines)
+{
+    string path = filename_for(object);
+    string tmp = path + ".tmp";
+    string key = get_key(object, build_id);
+    static const char zeroes[8] = { 0 };
+
+    header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, magic, sizeof(h.magic));
+    h.version = VERSION;
+    h.key_length = key.length();
+    h.info_size = info_size;
+    h.ncus = cu_offsets.size();
+    h.nfunctions = functions.size();
+    h.ninlines = inlines.size();
+
+    FILE *fp = fopen(tmp.c_str(), "w");
+    if (!fp)
+    {
+	eprintf("cannot write index file %s: %s\n", tmp.c_str(), strerror(errno));
+	return false;
+    }
+    fwrite(&h, sizeof(h), 1, fp);
+    fwrite(key.data(), 1, key.length(), fp);
+    fwrite(zeroes, 1, pad8(key.length()) - key.length(), fp);
+    fwrite(cu_offsets.data(), sizeof(uint64_t), cu_offsets.size(), fp);
+    write_index(fp, functions);
+    write_index(fp, inlines);
+    bool failed = ferror(fp);
+    if (fclose(fp) < 0)
+	failed = true;
+    if (failed || rename(tmp.c_str(), path.c_str()) < 0)
+    {
+	eprintf("cannot write index file %s: %s\n", path.c_str(), strerror(errno));
+	unlink(tmp.c_str());
+	return false;
+    }
+    dprintf("wrote index file %s: %u compile units, %u functions, %u inlines\n",
+	    path.c_str(), h.ncus, h.nfunctions, h.ninlines);
+    return true;
+}
+
+bool
+index_file_t::map(const char *object, const string &build_id,
+		  uint64_t info_size)
+{
+    unmap();
+    string path = filename_for(object);
+    int fd = open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+	return false;
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || (unsigned long)sb.st_size < sizeof(header_t))
+    {
+	close(fd);
+	dprintf("ignoring truncated index file %s\n", path.c_str());
+	return false;
+    }
+    void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+	return false;
+    map_ = map;
+    size_ = sb.st_size;
+    header_ = (const header_t *)map_;
+
+    const char *p = (const char *)map_ + sizeof(header_t);
+    string key = get_key(object, build_id);
+    uint64_t expected = sizeof(header_t) + pad8(header_->key_length) +
+			(uint64_t)header_->ncus * sizeof(uint64_t) +
+			((uint64_t)header_->nfunctions + header_->ninlines) * 4 * sizeof(uint64_t);
+    if (memcmp(header_->magic, magic, sizeof(magic)) ||
+	header_->version != VERSION ||
+	expected != size_ ||
+	header_->info_size != info_size ||
+	header_->key_length != key.length() ||
+	memcmp(p, key.data(), key.length()))
+    {
+	dprintf("ignoring stale index file %s\n", path.c_str());
+	unmap();
+	return false;
+    }
+    p += pad8(header_->key_length);
+    cu_offsets_ = (const uint64_t *)p;
+    p += header_->ncus * sizeof(uint64_t);
+    p = attach_index(p, header_->nfunctions, functions_);
+    attach_index(p, header_->ninlines, inlines_);
+    dprintf("mapped index file %s\n", path.c_str());
+    return true;
+}
+
+/* Point @index at the @n element arrays written by write_index()
+ * starting at @p, and return the end of them. */
+const char *
+index_file_t::attach_index(const char *p, uint32_t n, index_t &index)
+{
+    const uint64_t *a = (const uint64_t *)p;
+    index.attach(n, a, a + n, a + 2*n, a + 3*n);
+    return (const char *)(a + 4*n);
+}
+
+void
+index_file_t::unmap()
+{
+    if (map_)
+	munmap(map_, size_);
+    map_ = 0;
+    size_ = 0;
+    header_ = 0;
+    functions_.clear();
+    inlines_.clear();
+}
+
+// close namespaces
+}; }; };
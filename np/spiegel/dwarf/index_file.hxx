@@ -0,0 +1,110 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __np_spiegel_dwarf_index_file_hxx__
+#define __np_spiegel_dwarf_index_file_hxx__ 1
+
+#include "np/spiegel/common.hxx"
+#include "np/util/range_index.hxx"
+#include <vector>
+
+namespace np {
+namespace spiegel {
+namespace dwarf {
+
+/*
+ * A precomputed index of the functions in one link object, written
+ * to a side file next to the object (see filename_for()) so that
+ * later runs can skip walking every DIE at startup.  The file holds
+ * two built range_index arrays, from recorded addresses to functions
+ * and to inlined subroutines, which are mapped read-only and searched
+ * in place.  Values are the index of a compile unit in the link object
+ * and a DIE offset within it, so the file is position independent.
+ * It's keyed by the object's build-id, or failing that its size and
+ * mtime, and by the size of its .debug_info, so a stale file is ignored.
+ */
+class index_file_t
+{
+public:
+    typedef np::util::range_index<uint64_t, uint64_t> index_t;
+
+    static uint64_t make_value(uint32_t cu, uint32_t offset)
+    {
+	return ((uint64_t)cu << 32) | offset;
+    }
+    static uint32_t value_cu(uint64_t v) { return (uint32_t)(v >> 32); }
+    static uint32_t value_offset(uint64_t v) { return (uint32_t)v; }
+
+    index_file_t() : map_(0), size_(0), header_(0) {}
+    ~index_file_t() { unmap(); }
+
+    static std::string filename_for(const char *object);
+    /* Write the index file for @object, whose build-id (if any)
+     * is @build_id, from @functions and @inlines, which must have
+     * been built. */
+    static bool write(const char *object, const std::string &build_id,
+		      uint64_t info_size,
+		      const std::vector<uint64_t> &cu_offsets,
+		      const index_t &functions,
+		      const index_t &inlines);
+
+    /* Map the index file for @object, returning false if there
+     * isn't one or it doesn't match the object. */
+    bool map(const char *object, const std::string &build_id,
+	     uint64_t info_size);
+    void unmap();
+
+    uint32_t get_ncus() const { return header_->ncus; }
+    const uint64_t *get_cu_offsets() const { return cu_offsets_; }
+    /* These search the mapped file */
+    const index_t &get_functions() const { return functions_; }
+    const index_t &get_inlines() const { return inlines_; }
+
+private:
+    enum { VERSION = 2 };
+    static const char magic[8];
+
+    struct header_t
+    {
+	char magic[8];
+	uint32_t version;
+	// followed by the key, padded to 8 bytes, the compile unit
+	// offsets, then for functions and inlines in turn the los,
+	// his, maxhis and values arrays of a range_index
+	uint32_t key_length;
+	uint64_t info_size;
+	uint32_t ncus;
+	uint32_t nfunctions;
+	uint32_t ninlines;
+	uint32_t pad;
+    };
+
+    static std::string get_key(const char *object,
+			       const std::string &build_id);
+    static void write_index(FILE *fp, const index_t &index);
+    static const char *attach_index(const char *p, uint32_t n, index_t &index);
+
+    void *map_;
+    unsigned long size_;
+    const header_t *header_;
+    const uint64_t *cu_offsets_;
+    index_t functions_;
+    index_t inlines_;
+};
+
+// close namespaces
+}; }; };
+
+#endif // __np_spiegel_dwarf_index_file_hxx__
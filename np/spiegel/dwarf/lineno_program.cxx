@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include "np/util/common.hxx"
+#include <algorithm>
 #include "lineno_program.hxx"
 #include "enumerations.hxx"
 #include "np/util/log.hxx"
@@ -315,48 +316,131 @@ lineno_program_t::run(delegate_t *delegate)
     return rs.running_ ? SUCCESS : ERR_HALTED_BY_DELEGATE;
 }
 
+/* Rows at the same address are ordered with END_SEQUENCE rows
+ * first, so that a sequence which starts exactly where another
+ * ends is found.  Otherwise the order from the program is kept. */
 bool
-lineno_program_t::get_source_line(
-    np::spiegel::addr_t addr,
-    np::util::filename_t *filenamep,
-    uint32_t *linep, uint32_t *columnp)
+lineno_program_t::compare_line_rows(const line_row_t &a, const line_row_t &b)
 {
-    class get_source_line_delegate_t : public lineno_program_t::delegate_t
+    if (a.address != b.address)
+        return a.address < b.address;
+    return (a.file == END_SEQUENCE && b.file != END_SEQUENCE);
+}
+
+/* Run the Line Number Program once and keep all the ranges it
+ * describes in a compact table sorted by address. */
+void
+lineno_program_t::build_line_table()
+{
+    class line_table_delegate_t : public lineno_program_t::delegate_t
     {
     public:
-        get_source_line_delegate_t(addr_t a, np::util::filename_t *fp, uint32_t *lp, uint32_t *cp)
-          : seeking_(a),
-            filenamep_(fp),
-            linep_(lp),
-            columnp_(cp),
-            found_(false)
+        line_table_delegate_t(lineno_program_t &p)
+          : program_(p),
+            have_end_(false),
+            end_(0)
         { }
 
         bool receive_range(const lineno_program_t::range_t &r) override
         {
-            if (r.contains(seeking_))
-            {
-                found_ = true;
-                *filenamep_ = r.get_absolute_filename();
-                *linep_ = r.get_line();
-                *columnp_ = r.get_column();
-                return false;   /* stop running the Line Number Program */
-            }
+            addr_t start = r.get_start_address();
+            addr_t end = r.get_end_address();
+            /* an empty range can never contain an address */
+            if (end <= start)
+                return true;
+            if (have_end_ && end_ != start)
+                add_end_row();
+
+            uint32_t file = r.get_file();
+            if (file >= program_.line_files_.size())
+                program_.line_files_.resize(file+1);
+            if (!program_.line_files_[file].length())
+                program_.line_files_[file] = r.get_absolute_filename();
+
+            line_row_t row;
+            row.address = start;
+            row.file = file;
+            row.line = r.get_line();
+            row.column = r.get_column();
+            program_.line_rows_.push_back(row);
+            have_end_ = true;
+            end_ = end;
             return true;
         }
 
-        bool was_found() const { return found_; }
+        void add_end_row()
+        {
+            line_row_t row;
+            memset(&row, 0, sizeof(row));
+            row.address = end_;
+            row.file = END_SEQUENCE;
+            program_.line_rows_.push_back(row);
+            have_end_ = false;
+        }
+        void finish()
+        {
+            if (have_end_)
+                add_end_row();
+        }
 
     private:
-        addr_t seeking_;
-        np::util::filename_t *filenamep_;
-        uint32_t *linep_;
-        uint32_t *columnp_;
-        bool found_;
+        lineno_program_t &program_;
+        bool have_end_;
+        addr_t end_;
     };
-    get_source_line_delegate_t delegate(addr, filenamep, linep, columnp);
+
+    line_table_built_ = true;
+    line_table_delegate_t delegate(*this);
     status_t status = run(&delegate);
-    return (status == ERR_HALTED_BY_DELEGATE && delegate.was_found());
+    if (status != SUCCESS)
+        wprintf("Line Number Program failed with status %d, "
+                "using partial line table\n", (int)status);
+    delegate.finish();
+    stable_sort(line_rows_.begin(), line_rows_.end(), compare_line_rows);
+    dprintf("built line table with %u rows, %u files\n",
+            (unsigned)line_rows_.size(), (unsigned)line_files_.size());
+}
+
+bool
+lineno_program_t::get_source_line(
+    np::spiegel::addr_t addr,
+    np::util::filename_t *filenamep,
+    uint32_t *linep, uint32_t *columnp)
+{
+    if (!line_table_built_)
+        build_line_table();
+
+    /* find the last row at or before addr */
+    line_row_t key;
+    memset(&key, 0, sizeof(key));
+    key.address = addr;
+    vector<line_row_t>::const_iterator i =
+        upper_bound(line_rows_.begin(), line_rows_.end(), key,
+                    [](const line_row_t &a, const line_row_t &b)
+                    { return a.address < b.address; });
+    if (i == line_rows_.begin())
+        return false;
+    --i;
+    if (i->file == END_SEQUENCE)
+        return false;
+
+    *filenamep = line_files_[i->file];
+    *linep = i->line;
+    *columnp = i->column;
+    return true;
+}
+
+/* Return the absolute name of entry @file in the file table */
+np::util::filename_t
+lineno_program_t::get_filename(uint32_t file)
+{
+    if (!line_table_built_)
+        build_line_table();
+    if (file < line_files_.size() && line_files_[file].length())
+        return line_files_[file];
+    /* not used by any row in the line table */
+    run_state_t rs(*this);
+    return rs.get_absolute_filename(file);
 }
 
 // close namespaces
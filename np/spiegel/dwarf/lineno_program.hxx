@@ -25,7 +25,8 @@ namespace np {
 namespace spiegel {
 namespace dwarf {
 
-class lineno_program_t : public np::util::zalloc
+// Allocated from the state_t's arena, which provides zeroed memory.
+class lineno_program_t
 {
 public:
     lineno_program_t(const char *compilation_directory)
@@ -201,6 +202,7 @@ public:
             return true;
         }
 
+        uint32_t get_file() const { return run_state_.start_.file; }
         np::util::filename_t get_absolute_filename() const
         {
             return run_state_.get_absolute_filename(run_state_.start_.file);
@@ -246,6 +248,7 @@ public:
                          /*out*/np::util::filename_t *filenamep,
                          /*out*/uint32_t *linep,
                          /*out*/uint32_t *columnp);
+    np::util::filename_t get_filename(uint32_t file);
 
 private:
     int32_t special_opcode_line_advance(uint8_t opcode) const
@@ -259,6 +262,19 @@ private:
         return adjusted_opcode / line_range_;
     }
 
+    // One row of the line table built from the program.  Each row
+    // describes the addresses from its own up to the next row's.
+    struct line_row_t
+    {
+        addr_t address;
+        uint32_t file;      // index into line_files_, or END_SEQUENCE
+        uint32_t line;
+        uint32_t column;
+    };
+    enum { END_SEQUENCE = 0xffffffff };
+    static bool compare_line_rows(const line_row_t &a, const line_row_t &b);
+    void build_line_table();
+
     // read from the .debug_info attributes, passed in by compile_unit_t
     // used to make absolure filenames
     const char *compilation_directory_;
@@ -283,6 +299,14 @@ private:
     std::vector<const char *> include_directories_;
     std::vector<file_table_entry_t> files_;
 
+    // The program's results, built once on first use and sorted by
+    // address.  The end of each sequence is marked by an END_SEQUENCE
+    // row, so addresses in the gaps between sequences aren't found.
+    bool line_table_built_;
+    std::vector<line_row_t> line_rows_;
+    // absolute filenames, indexed by file register value
+    std::vector<np::util::filename_t> line_files_;
+
     friend run_state_t;
 };
 
@@ -15,9 +15,16 @@
  */
 #include "np/spiegel/common.hxx"
 #include <sys/fcntl.h>
+#include <sys/mman.h>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
 #include <bfd.h>
+#include <algorithm>
+#include <new>
 #include "state.hxx"
 #include "link_object.hxx"
+#include "compile_unit.hxx"
 #include "np/util/log.hxx"
 
 namespace np { namespace spiegel { namespace dwarf {
@@ -93,6 +100,64 @@ static void _np_bfd_error_handler(const char *fmt, ...)
 }
 #endif
 
+/* Use BFD to find the sections in an object file which
+ * the platform can't read directly. */
+static bool
+get_bfd_sections(const char *path,
+		 vector<np::spiegel::platform::file_section_t> &sections)
+{
+    bfd_init();
+    bfd_set_error_handler(_np_bfd_error_handler);
+
+    dprintf("opening bfd %s\n", path);
+    bfd *b = bfd_openr(path, NULL);
+    if (!b)
+    {
+        eprintf("BFD library failed to open %s: %s\n",
+                path, bfd_errmsg(bfd_get_error()));
+	return false;
+    }
+    bool r = false;
+    if (!bfd_check_format(b, bfd_object))
+    {
+	eprintf("%s: not an object\n", path);
+    }
+    else
+    {
+	for (asection *sec = b->sections ; sec ; sec = sec->next)
+	{
+	    np::spiegel::platform::file_section_t fs;
+	    fs.name = sec->name;
+	    fs.offset = (unsigned long)sec->filepos;
+	    fs.size = (unsigned long)sec->size;
+	    fs.compressed = false;
+	    fs.uncompressed_size = fs.size;
+	    sections.push_back(fs);
+	}
+	r = true;
+    }
+    bfd_close(b);
+    return r;
+}
+
+/* Return the DW_sec_* index of the section named @name, or
+ * DW_sec_none.  In a .dwo or .dwp file the sections are named
+ * with a .dwo suffix, except for the .dwp's index. */
+static int
+section_index(const std::string &name, bool is_split)
+{
+    static const char suffix[] = ".dwo";
+    static const size_t suffixlen = sizeof(suffix)-1;
+
+    if (!is_split)
+	return secnames.to_index(name.c_str());
+    if (name.length() > suffixlen &&
+	!name.compare(name.length()-suffixlen, suffixlen, suffix))
+	return secnames.to_index(name.substr(0, name.length()-suffixlen).c_str());
+    int idx = secnames.to_index(name.c_str());
+    return (idx == DW_sec_cu_index ? idx : (int)DW_sec_none);
+}
+
 bool
 link_object_t::map_sections()
 {
@@ -102,61 +167,92 @@ link_object_t::map_sections()
     int nsec = 0;   /* number of DWARF sections to be explicitly mapped herein */
     int ndwarf = 0; /* number of DWARF sections in the linkobj */
 
-    bfd_init();
-    bfd_set_error_handler(_np_bfd_error_handler);
+    dprintf("trying %s\n", filename_);
+    /* Reading the section headers ourselves is much faster than
+     * BFD, which is only needed for non-native object formats */
+    vector<np::spiegel::platform::file_section_t> secs;
+    if (!np::spiegel::platform::get_file_sections(filename_, secs) &&
+	!get_bfd_sections(filename_, secs))
+	return false;
 
-    dprintf("opening bfd %s\n", filename_);
-    /* Open a BFD */
+    /* The section table is read only once, here, so the build-id
+     * is kept for finding the debug file and the index file */
     std::string path;
-    bool is_separate = np::spiegel::platform::symbol_filename(filename_, path);
+    bool is_separate = false;
+    if (!is_split_)
+    {
+	np::spiegel::platform::get_build_id(filename_, secs, build_id_);
+	is_separate = np::spiegel::platform::symbol_filename(filename_, secs,
+							     build_id_, path);
+    }
     if (!is_separate)
 	path = filename_;
 
-    dprintf("trying %s\n", path.c_str());
-    bfd *b = bfd_openr(path.c_str(), NULL);
-    if (!b)
-    {
-        eprintf("BFD library failed to open %s: %s\n",
-                path.c_str(), bfd_errmsg(bfd_get_error()));
-	return false;
-    }
-    if (!bfd_check_format(b, bfd_object))
+    /* A separate debug file has the DWARF sections, but only
+     * placeholders for the loaded sections like the PLT and .eh_frame,
+     * so we take those from the object itself. */
+    vector<np::spiegel::platform::file_section_t> debug_secs;
+    if (is_separate)
     {
-	eprintf("%s: not an object\n", path.c_str());
-	goto error;
+	dprintf("trying separate debug file %s\n", path.c_str());
+	if (!np::spiegel::platform::get_file_sections(path.c_str(), debug_secs) &&
+	    !get_bfd_sections(path.c_str(), debug_secs))
+	{
+	    wprintf("cannot read separate debug file %s, ignoring\n", path.c_str());
+	    is_separate = false;
+	    path = filename_;
+	}
     }
     dprintf("Object %s\n", path.c_str());
 
     /* Extract the file shape of the DWARF sections */
     dprintf("sections:\n");
-    asection *sec;
-    for (sec = b->sections ; sec ; sec = sec->next)
+    for (const np::spiegel::platform::file_section_t &sec : secs)
     {
-	if (np::spiegel::platform::is_plt_section(sec->name))
+	if (np::spiegel::platform::is_plt_section(sec.name.c_str()))
 	{
-	    mapping_t m((unsigned long)sec->filepos,
-			(unsigned long)sec->size);
+	    mapping_t m(sec.offset, sec.size);
 	    if (map_from_system(m))
 		plts_.push_back(m);
 	    continue;
 	}
 
-	int idx = secnames.to_index(sec->name);
+	if (sec.name == ".eh_frame")
+	{
+	    /* .eh_frame is loaded at runtime, and pointers in it
+	     * are relative to where it's loaded.  A separate debug
+	     * file has only a placeholder for it. */
+	    eh_frame_.set_range(sec.offset, sec.size);
+	    if (map_from_system(eh_frame_))
+		dprintf("found system mapping for section .eh_frame\n");
+	    continue;
+	}
+	if (is_separate)
+	    continue;
+
+	int idx = section_index(sec.name, is_split_);
 	dprintf("section name %s size %lx filepos %lx index %d\n",
-		sec->name, (unsigned long)sec->size,
-		(unsigned long)sec->filepos, idx);
+		sec.name.c_str(), sec.size, sec.offset, idx);
 	if (idx == DW_sec_none)
 	    continue;
 	ndwarf++;
-	sections_[idx].set_range((unsigned long)sec->filepos,
-				 (unsigned long)sec->size);
+	sections_[idx].set_range(sec.offset, sec.size);
+	sections_[idx].set_uncompressed_size(sec.compressed ? sec.uncompressed_size : 0);
 
-	if (!is_separate)
-	{
-	    if (map_from_system(sections_[idx]))
-		dprintf("found system mapping for section %s\n",
-			secnames.to_name(idx));
-	}
+	if (map_from_system(sections_[idx]))
+	    dprintf("found system mapping for section %s\n",
+		    secnames.to_name(idx));
+    }
+    for (const np::spiegel::platform::file_section_t &sec : debug_secs)
+    {
+	int idx = section_index(sec.name, /*is_split*/false);
+	dprintf("section name %s size %lx filepos %lx index %d\n",
+		sec.name.c_str(), sec.size, sec.offset, idx);
+	if (idx == DW_sec_none)
+	    continue;
+	ndwarf++;
+	sections_[idx].set_range(sec.offset, sec.size);
+	sections_[idx].set_uncompressed_size(sec.compressed ? sec.uncompressed_size : 0);
     }
 
     if (!ndwarf)
@@ -216,7 +312,7 @@ link_object_t::map_sections()
 
 	for (m = mappings_.begin() ; m != mappings_.end() ; ++m)
 	{
-	    if (m->mmap(fd, /*read-only*/false) < 0)
+	    if (m->mmap(fd, /*rw*/false) < 0)
 	    {
                 eprintf("Failed to mmap %s: %s", path.c_str(), strerror(errno));
 		goto error;
@@ -235,6 +331,7 @@ link_object_t::map_sections()
 		}
 	    }
 	    assert(tsec[idx]->is_mapped());
+	    advise_section(tsec[idx] - sections_);
 	}
     }
 
@@ -264,18 +361,332 @@ error:
 out:
     if (fd >= 0)
 	close(fd);
-    bfd_close(b);
     return r;
 }
 
+/* Tell the kernel how a section we mapped will be used.  The
+ * sections which are scanned from start to end while reading the
+ * compile units are read in now, and readahead is turned off for
+ * the others as they're only read here and there, on lookups. */
+void
+link_object_t::advise_section(int idx)
+{
+    const section_t &sec = sections_[idx];
+    unsigned long start = page_round_down((unsigned long)sec.get_map());
+    unsigned long end = page_round_up((unsigned long)sec.get_map() + sec.get_size());
+    int advice;
+    switch (idx)
+    {
+    case DW_sec_info:
+    case DW_sec_abbrev:
+    case DW_sec_str:
+	advice = MADV_WILLNEED;
+	break;
+    default:
+	advice = MADV_RANDOM;
+	break;
+    }
+    if (madvise((void *)start, end - start, advice) < 0)
+	dprintf("madvise(%s) failed: %s\n", secnames.to_name(idx), strerror(errno));
+}
+
+/* Count the bytes of DWARF sections we mapped ourselves or
+ * inflated, and how many of those are resident in memory.  For
+ * a file mapping that's the pages we've touched plus any the
+ * kernel has read ahead or already had in its page cache. */
+void
+link_object_t::get_mapping_stats(unsigned long &mapped,
+				 unsigned long &resident) const
+{
+    mapped = resident = 0;
+    for (const section_t &m : mappings_)
+    {
+	if (!m.get_map())
+	    continue;
+	mapped += m.get_size();
+	resident += np::spiegel::platform::resident_bytes(m.get_map(), m.get_size());
+    }
+    for (const mapping_t &im : inflated_)
+    {
+	mapped += im.get_size();
+	resident += np::spiegel::platform::resident_bytes(im.get_map(), im.get_size());
+    }
+}
+
 void
 link_object_t::unmap_sections()
 {
+    if (is_enabled_for(np::log::DEBUG) && (mappings_.size() || inflated_.size()))
+    {
+	unsigned long mapped, resident;
+	get_mapping_stats(mapped, resident);
+	dprintf("unmapping %s: %lu bytes mapped, %lu bytes resident\n",
+		filename_, mapped, resident);
+    }
     vector<section_t>::iterator m;
     for (m = mappings_.begin() ; m != mappings_.end() ; ++m)
     {
 	m->munmap();
     }
+    for (mapping_t &im : inflated_)
+	im.munmap();
+    inflated_.clear();
+}
+
+/* Decompress a section, which was mapped as its compressed data,
+ * into an anonymous mapping.  This is done on first use so that
+ * sections which are never looked at are never inflated. */
+void
+link_object_t::inflate_section(section_t &sec) const
+{
+    unsigned long size = sec.get_uncompressed_size();
+    sec.set_uncompressed_size(0);
+    dprintf("inflating section at offset 0x%lx from 0x%lx to 0x%lx bytes\n",
+	    sec.get_offset(), sec.get_size(), size);
+#if HAVE_ZLIB
+    if (sec.is_mapped())
+    {
+	void *map = ::mmap(NULL, size, PROT_READ|PROT_WRITE,
+			   MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED)
+	{
+	    eprintf("Failed to mmap %lu bytes: %s\n", size, strerror(errno));
+	    goto fail;
+	}
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	zs.next_in = (Bytef *)sec.get_map();
+	zs.avail_in = sec.get_size();
+	zs.next_out = (Bytef *)map;
+	zs.avail_out = size;
+	int r = inflateInit(&zs);
+	if (r == Z_OK)
+	{
+	    r = inflate(&zs, Z_FINISH);
+	    inflateEnd(&zs);
+	}
+	if (r != Z_STREAM_END || zs.total_out != size)
+	{
+	    eprintf("Failed to inflate compressed section in %s\n", filename_);
+	    ::munmap(map, size);
+	    goto fail;
+	}
+	mprotect(map, size, PROT_READ);
+
+	inflated_.push_back(mapping_t(0, size, map));
+	sec.set_map(map);
+	sec.set_size(size);
+	return;
+    }
+fail:
+#else
+    eprintf("Cannot read compressed section in %s, "
+	    "NovaProva was built without zlib\n", filename_);
+#endif
+    /* behave as if the section were absent */
+    sec.set_map(0);
+    sec.set_size(0);
+}
+
+/* Build the table used to unwind stack frames in this object,
+ * preferring .eh_frame because it's always present in code which
+ * might throw C++ exceptions, and falling back to .debug_frame. */
+bool
+link_object_t::read_cfi()
+{
+    if (eh_frame_.is_mapped())
+	return cfi_.read(eh_frame_, /*is_eh*/true, slide_);
+    const section_t *frame = get_section(DW_sec_frame);
+    if (frame->is_mapped() && frame->get_size())
+	return cfi_.read(*frame, /*is_eh*/false, slide_);
+    cfi_.clear();
+    return true;
+}
+
+/* Return the parsed abbrev table at the given offset in the
+ * .debug_abbrev section, parsing it on first use.  Compile units
+ * which share an abbrev table share the parsed table too. */
+const abbrev_table_t *
+link_object_t::get_abbrev_table(uint32_t offset)
+{
+    map<uint32_t, abbrev_table_t*>::iterator i = abbrev_tables_.find(offset);
+    if (i != abbrev_tables_.end())
+    {
+	dprintf("reusing abbrevs at offset 0x%x\n", offset);
+	return i->second;
+    }
+
+    reader_t r = get_section(DW_sec_abbrev)->get_contents();
+    arena_t &arena = state_->get_arena();
+    abbrev_table_t *table = new(arena.alloc(sizeof(abbrev_table_t))) abbrev_table_t(offset);
+    if (!table->read(r, arena))
+	return 0;
+    abbrev_tables_[offset] = table;
+    return table;
+}
+
+static bool
+compare_cu_offsets(const compile_unit_t *a, const compile_unit_t *b)
+{
+    return a->get_start_offset() < b->get_start_offset();
+}
+
+/* Record the compile units read from this object's .debug_info
+ * section, so that references into that section can be resolved
+ * with a binary search rather than a scan of every compile unit. */
+void
+link_object_t::index_compile_units(const vector<compile_unit_t*> &cus)
+{
+    compile_units_ = cus;
+    sort(compile_units_.begin(), compile_units_.end(), compare_cu_offsets);
+}
+
+static bool
+compare_offset_cu(np::spiegel::offset_t off, const compile_unit_t *cu)
+{
+    return off < cu->get_start_offset();
+}
+
+/* Return the compile unit whose .debug_info range contains
+ * the given section offset, or 0 if there is none. */
+compile_unit_t *
+link_object_t::find_compile_unit(np::spiegel::offset_t off) const
+{
+    /* first compile unit which starts after off */
+    vector<compile_unit_t*>::const_iterator i =
+	upper_bound(compile_units_.begin(), compile_units_.end(),
+		    off, compare_offset_cu);
+    if (i == compile_units_.begin())
+	return 0;
+    --i;
+    if (off >= (*i)->get_end_offset())
+	return 0;
+    return *i;
+}
+
+/* Return the link object for the .dwo or .dwp file at @path,
+ * opening it on first use, or 0 if it doesn't exist. */
+link_object_t *
+link_object_t::get_split_object(const string &path)
+{
+    map<string, link_object_t*>::iterator i = split_objects_.find(path);
+    if (i != split_objects_.end())
+	return i->second;
+
+    link_object_t *so = 0;
+    if (!access(path.c_str(), R_OK))
+    {
+	dprintf("opening split DWARF file %s\n", path.c_str());
+	so = new link_object_t(path.c_str(), state_);
+	so->is_split_ = true;
+	if (!so->map_sections() || !so->has_sections())
+	{
+	    delete so;
+	    so = 0;
+	}
+    }
+    /* remember failures too, so we only look once */
+    split_objects_[path] = so;
+    return so;
+}
+
+/* Find the split unit for the skeleton compile unit with the
+ * given DW_AT_GNU_dwo_name, DW_AT_comp_dir and DW_AT_GNU_dwo_id,
+ * looking first in a .dwp package next to this object, as made
+ * by the dwp tool, then for the .dwo file written by the compiler.
+ * The .dwo is looked for next to this object as well, in case
+ * the build tree was moved after linking. */
+bool
+link_object_t::find_split_unit(const char *dwo_name, const char *comp_dir,
+			       uint64_t dwo_id, split_unit_t &su)
+{
+    memset(&su, 0, sizeof(su));
+
+    link_object_t *so = get_split_object(string(filename_) + ".dwp");
+    if (so && so->find_package_unit(dwo_id, su))
+    {
+	su.object = so;
+	return true;
+    }
+
+    if (!dwo_name)
+	return false;
+    filename_t dwo(dwo_name);
+    so = get_split_object(dwo.make_absolute_to_dir(filename_t(comp_dir)));
+    if (!so)
+	so = get_split_object(dwo.basename().make_absolute_to_file(filename_t(filename_)));
+    if (!so)
+	return false;
+    /* a .dwo holds just the one compile unit */
+    su.object = so;
+    return true;
+}
+
+/* Look up a unit in the .debug_cu_index hash table of a .dwp
+ * package, as described in the DWARF-5 standard section 7.3.5.
+ * The version 2 format is the GNU extension used with DWARF-4. */
+bool
+link_object_t::find_package_unit(uint64_t dwo_id, split_unit_t &su) const
+{
+    reader_t r = get_section(DW_sec_cu_index)->get_contents();
+    uint32_t version, ncolumns, nunits, nslots;
+    if (!r.read_u32(version) ||
+	!r.read_u32(ncolumns) ||
+	!r.read_u32(nunits) ||
+	!r.read_u32(nslots))
+	return false;
+    if (version != 2 || !nslots || (nslots & (nslots-1)))
+    {
+	wprintf("unsupported .debug_cu_index version %u in %s\n",
+		version, filename_);
+	return false;
+    }
+    /* the header is followed by the signatures, the
+     * row numbers, the column ids, the offsets and
+     * the sizes */
+    size_t sigs = r.get_offset();
+    size_t rows = sigs + 8 * (size_t)nslots;
+    size_t columns = rows + 4 * (size_t)nslots;
+    size_t offsets = columns + 4 * (size_t)ncolumns;
+
+    uint32_t mask = nslots - 1;
+    uint32_t h = dwo_id & mask;
+    uint32_t h2 = ((dwo_id >> 32) & mask) | 1;
+    uint32_t row = 0;
+    for (uint32_t n = 0 ; n < nslots ; n++, h = (h + h2) & mask)
+    {
+	uint64_t sig;
+	uint32_t slotrow;
+	if (!r.seek(sigs + 8 * (size_t)h) || !r.read_u64(sig) ||
+	    !r.seek(rows + 4 * (size_t)h) || !r.read_u32(slotrow))
+	    return false;
+	if (!slotrow)
+	    break;	/* empty slot, not present */
+	if (sig == dwo_id)
+	{
+	    row = slotrow;
+	    break;
+	}
+    }
+    if (!row || row > nunits)
+	return false;
+
+    for (uint32_t c = 0 ; c < ncolumns ; c++)
+    {
+	uint32_t id, off;
+	if (!r.seek(columns + 4 * (size_t)c) || !r.read_u32(id) ||
+	    !r.seek(offsets + 4 * ((size_t)(row-1) * ncolumns + c)) ||
+	    !r.read_u32(off))
+	    return false;
+	switch (id)
+	{
+	case DW_SECT_INFO: su.info_offset = off; break;
+	case DW_SECT_ABBREV: su.abbrev_offset = off; break;
+	case DW_SECT_STR_OFFSETS: su.str_offsets_offset = off; break;
+	}
+    }
+    return true;
 }
 
 compile_unit_offset_tuple_t
@@ -20,57 +20,126 @@
 #include "np/spiegel/mapping.hxx"
 #include "section.hxx"
 #include "reference.hxx"
+#include "abbrev.hxx"
+#include "cfi.hxx"
+#include "index_file.hxx"
 
 namespace np {
 namespace spiegel {
 namespace dwarf {
 
 class state_t;
+class compile_unit_t;
 
 class link_object_t : public reference_resolver_t
 {
 public:
     link_object_t(const char *n, state_t *state)
      :  filename_(np::util::xstrdup(n)),
-        state_(state)
+        state_(state),
+        slide_(0),
+        is_split_(false),
+        index_file_(0)
     {
         memset(sections_, 0, sizeof(sections_));
     }
     ~link_object_t()
     {
+        for (auto &i : split_objects_)
+            delete i.second;
+        delete index_file_;
         unmap_sections();
         free(filename_);
     }
 
     const char *get_filename() const { return filename_; }
-    const section_t *get_section(uint32_t i) const { return i < DW_sec_num ? &sections_[i] : 0; }
+    /* raw bytes, empty if the object has no build-id */
+    const std::string &get_build_id() const { return build_id_; }
+    const section_t *get_section(uint32_t i) const
+    {
+	if (i >= DW_sec_num)
+	    return 0;
+	if (sections_[i].is_compressed())
+	    inflate_section(sections_[i]);
+	return &sections_[i];
+    }
     np::spiegel::addr_t live_address(np::spiegel::addr_t addr) const { return addr ? addr + slide_ : addr; }
     np::spiegel::addr_t recorded_address(np::spiegel::addr_t addr) const { return addr ? addr - slide_ : addr; }
     reference_t make_reference(np::spiegel::offset_t off) const
     {
         return reference_t::make(this, off);
     }
+    const abbrev_table_t *get_abbrev_table(uint32_t offset);
+    compile_unit_t *find_compile_unit(np::spiegel::offset_t off) const;
+    const cfi_table_t &get_cfi() const { return cfi_; }
     compile_unit_offset_tuple_t resolve_reference(const reference_t &ref) const override;
     std::string describe_resolver() const override;
 
     /* interface for state_t */
     void set_system_mappings(const std::vector<np::spiegel::mapping_t> &mappings) { system_mappings_ = mappings; }
     void set_slide(unsigned long s) { slide_ = s; }
+    /* false if the object was read from a file but isn't loaded */
+    bool has_system_mappings() const { return system_mappings_.size() > 0; }
     bool is_in_plt(np::spiegel::addr_t addr) const;
     bool has_sections() const { return sections_[DW_sec_info].get_size() > 0; }
     bool map_from_system(mapping_t &m) const;
     bool map_sections();
     void unmap_sections();
+    void get_mapping_stats(unsigned long &mapped, unsigned long &resident) const;
+    bool read_cfi();
+    void index_compile_units(const std::vector<compile_unit_t*> &cus);
+    const std::vector<compile_unit_t*> &get_compile_units() const { return compile_units_; }
+    /* the mapped index file which indexes the functions, if any;
+     * the link object takes ownership */
+    bool has_index_file() const { return (index_file_ != 0); }
+    const index_file_t *get_index_file() const { return index_file_; }
+    void set_index_file(index_file_t *idx) { delete index_file_; index_file_ = idx; }
+
+    /* interface for compile_unit_t, for split DWARF */
+    struct split_unit_t
+    {
+	/* the .dwo or .dwp file holding the unit, and where the
+	 * unit's contributions to its sections start */
+	link_object_t *object;
+	np::spiegel::offset_t info_offset;
+	uint32_t abbrev_offset;
+	uint32_t str_offsets_offset;
+    };
+    bool find_split_unit(const char *dwo_name, const char *comp_dir,
+			 uint64_t dwo_id, split_unit_t &su);
 
 private:
+    void inflate_section(section_t &sec) const;
+    void advise_section(int idx);
+    link_object_t *get_split_object(const std::string &path);
+    bool find_package_unit(uint64_t dwo_id, split_unit_t &su) const;
 
     char *filename_;
+    std::string build_id_;
     state_t *state_;
     unsigned long slide_;
-    section_t sections_[DW_sec_num];
+    /* mutable because compressed sections are inflated on first use */
+    mutable section_t sections_[DW_sec_num];
     std::vector<section_t> mappings_;
+    /* anonymous mappings holding inflated sections */
+    mutable std::vector<np::spiegel::mapping_t> inflated_;
     std::vector<np::spiegel::mapping_t> system_mappings_;
     std::vector<np::spiegel::mapping_t> plts_;
+    /* .eh_frame, only if it's in the system mappings */
+    section_t eh_frame_;
+    cfi_table_t cfi_;
+    /* parsed .debug_abbrev tables, keyed by section offset;
+     * they live in the state_t's arena */
+    std::map<uint32_t, abbrev_table_t*> abbrev_tables_;
+    /* compile units in this object, sorted by .debug_info offset */
+    std::vector<compile_unit_t*> compile_units_;
+    /* true for a .dwo or .dwp file, whose sections are
+     * named with a .dwo suffix */
+    bool is_split_;
+    /* .dwo and .dwp files opened for split units, keyed by
+     * pathname; 0 for files which couldn't be opened */
+    std::map<std::string, link_object_t*> split_objects_;
+    index_file_t *index_file_;
 };
 
 // close namespaces
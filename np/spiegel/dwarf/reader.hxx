@@ -19,6 +19,16 @@
 #include "np/spiegel/common.hxx"
 #include "np/util/log.hxx"
 
+// The word-at-a-time LEB128 decoder assumes it can
+// load a little-endian uint64_t from any alignment.
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && \
+    (defined(_NP_x86) || defined(_NP_x86_64))
+#define _NP_READER_WORDWISE_LEB128 1
+#else
+#define _NP_READER_WORDWISE_LEB128 0
+#endif
+
 namespace np {
 namespace spiegel {
 namespace dwarf {
@@ -165,6 +175,25 @@ public:
 
     bool read_uleb128(uint32_t &v)
     {
+	if (p_ < end_ && !(*p_ & 0x80))
+	{
+	    // the overwhelmingly common case, a single byte
+	    v = *p_++;
+	    return true;
+	}
+#if _NP_READER_WORDWISE_LEB128
+	if (end_ - p_ >= (ptrdiff_t)sizeof(uint64_t))
+	{
+	    uint64_t w = load_word();
+	    unsigned n = leb128_length(w);
+	    if (n && n <= MAX_LEB128_32)
+	    {
+		v = (uint32_t)leb128_gather(w, n);
+		p_ += n;
+		return true;
+	    }
+	}
+#endif
 	const unsigned char *pp = p_;
 	uint32_t vv = 0;
 	unsigned shift = 0;
@@ -181,18 +210,35 @@ public:
     }
     bool skip_uleb128()
     {
-	const unsigned char *pp = p_;
-	do
-	{
-	    if (pp == end_)
-		return false;
-	} while ((*pp++) & 0x80);
-	p_ = pp;
-	return true;
+	return skip_leb128();
     }
 
     bool read_sleb128(int32_t &v)
     {
+	if (p_ < end_ && !(*p_ & 0x80))
+	{
+	    // single byte, sign extend from bit 6
+	    v = (int32_t)((*p_ ^ 0x40) - 0x40);
+	    p_++;
+	    return true;
+	}
+#if _NP_READER_WORDWISE_LEB128
+	if (end_ - p_ >= (ptrdiff_t)sizeof(uint64_t))
+	{
+	    uint64_t w = load_word();
+	    unsigned n = leb128_length(w);
+	    if (n && n <= MAX_LEB128_32)
+	    {
+		uint64_t vv = leb128_gather(w, n);
+		// sign extend the result, from the last encoded bit
+		if (p_[n-1] & 0x40)
+		    vv |= ~0ULL << (7*n);
+		v = (int32_t)vv;
+		p_ += n;
+		return true;
+	    }
+	}
+#endif
 	const unsigned char *pp = p_;
 	uint32_t vv = 0;
 	unsigned shift = 0;
@@ -215,14 +261,7 @@ public:
     }
     bool skip_sleb128()
     {
-	const unsigned char *pp = p_;
-	do
-	{
-	    if (pp == end_)
-		return false;
-	} while ((*pp++) & 0x80);
-	p_ = pp;
-	return true;
+	return skip_leb128();
     }
 
     bool read_u16(uint16_t &v)
@@ -326,6 +365,75 @@ public:
     }
 
 private:
+    enum
+    {
+	// longest encoding of a 32-bit value
+	MAX_LEB128_32 = 5
+    };
+
+    // Skipping is the same for signed and unsigned LEB128s.
+    bool skip_leb128()
+    {
+	if (p_ < end_ && !(*p_ & 0x80))
+	{
+	    p_++;
+	    return true;
+	}
+#if _NP_READER_WORDWISE_LEB128
+	if (end_ - p_ >= (ptrdiff_t)sizeof(uint64_t))
+	{
+	    unsigned n = leb128_length(load_word());
+	    if (n)
+	    {
+		p_ += n;
+		return true;
+	    }
+	}
+#endif
+	const unsigned char *pp = p_;
+	do
+	{
+	    if (pp == end_)
+		return false;
+	} while ((*pp++) & 0x80);
+	p_ = pp;
+	return true;
+    }
+
+#if _NP_READER_WORDWISE_LEB128
+    /*
+     * Word-at-a-time LEB128 decoding.  When at least 8 bytes
+     * remain we load them all at once, find the terminating byte
+     * (the first one without the continuation bit) with a single
+     * bit scan, and gather the 7-bit groups with masks and shifts,
+     * instead of a bounds check and a branch per byte.  Callers
+     * fall back to the bytewise loop near the end of the buffer.
+     */
+    uint64_t load_word() const
+    {
+	uint64_t w;
+	memcpy(&w, p_, sizeof(w));
+	return w;
+    }
+    // Returns the length in bytes of the LEB128 at
+    // the start of @w, or 0 if it's longer than 8 bytes.
+    static unsigned leb128_length(uint64_t w)
+    {
+	uint64_t stops = ~w & 0x8080808080808080ULL;
+	return (stops ? (__builtin_ctzll(stops) >> 3) + 1 : 0);
+    }
+    // Returns the value of the first @n bytes of @w, n <= 5
+    static uint64_t leb128_gather(uint64_t w, unsigned n)
+    {
+	w &= ~0ULL >> (64 - 8*n);
+	return ((w & 0x7fULL) |
+		((w & 0x7f00ULL) >> 1) |
+		((w & 0x7f0000ULL) >> 2) |
+		((w & 0x7f000000ULL) >> 3) |
+		((w & 0x7f00000000ULL) >> 4));
+    }
+#endif
+
     const unsigned char *p_;
     const unsigned char *end_;
     const unsigned char *base_;
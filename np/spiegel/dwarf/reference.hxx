@@ -67,7 +67,9 @@ struct reference_t
      *
      * - Defined in DWARF4.pdf p150.  Stored as DW_FORM_ref_sig8.
      *   The offset is the 64bit type signature calculated for
-     *   a type DIE.  This is not yet implemented.
+     *   a type DIE, which is in a type unit in .debug_types.
+     *   These are looked up in the state_t's index of type units
+     *   when decoded, and become references of the first type.
      */
 
     const reference_resolver_t *resolver;
@@ -28,6 +28,14 @@ namespace dwarf {
 struct section_t : public np::spiegel::mapping_t
 {
 public:
+    section_t() : uncompressed_size_(0) {}
+
+    /* A compressed section is mapped as the compressed data
+     * and is inflated by the link_object_t on first use. */
+    bool is_compressed() const { return !!uncompressed_size_; }
+    unsigned long get_uncompressed_size() const { return uncompressed_size_; }
+    void set_uncompressed_size(unsigned long sz) { uncompressed_size_ = sz; }
+
     reader_t get_contents() const
     {
 	reader_t r(map_, size_);
@@ -45,6 +53,10 @@ public:
 	    return 0;
 	return v;
     }
+
+private:
+    // non-zero only while the section is compressed
+    unsigned long uncompressed_size_;
 };
 
 // close namespaces
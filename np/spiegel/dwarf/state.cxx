@@ -14,13 +14,16 @@
  * limitations under the License.
  */
 #include "np/spiegel/common.hxx"
+#include <new>
 #include "state.hxx"
 #include "reader.hxx"
 #include "compile_unit.hxx"
 #include "link_object.hxx"
 #include "walker.hxx"
+#include "index_file.hxx"
 #include "np/spiegel/platform/common.hxx"
 #include "np/util/log.hxx"
+#include "np/util/filename.hxx"
 
 namespace np { namespace spiegel { namespace dwarf {
 using namespace std;
@@ -30,7 +33,15 @@ static const char *get_partial_name(reference_t ref);
 
 state_t *state_t::instance_ = 0;
 
+static bool
+unwind_with_cfi(np::spiegel::platform::frame_t &frame)
+{
+    state_t *state = state_t::instance();
+    return state && state->unwind_frame(frame);
+}
+
 state_t::state_t()
+ :  nindex_files_(0)
 {
     assert(!instance_);
     instance_ = this;
@@ -38,11 +49,20 @@ state_t::state_t()
 
 state_t::~state_t()
 {
+    /* The arena doesn't run destructors, but compile
+     * units still own some std::vectors */
+    for (compile_unit_t *cu : compile_units_)
+	cu->~compile_unit_t();
+    for (compile_unit_t *tu : type_units_)
+	tu->~compile_unit_t();
     vector<link_object_t*>::iterator i;
     for (i = link_objects_.begin() ; i != link_objects_.end() ; ++i)
 	delete *i;
     address_index_.clear();
+    inline_index_.clear();
+    cu_index_.clear();
     link_object_index_.clear();
+    np::spiegel::platform::set_unwinder(0);
 
     assert(instance_ == this);
     instance_ = 0;
@@ -53,17 +73,19 @@ state_t::read_compile_units(link_object_t *lo)
 {
     dprintf("reading compile units for link_object %s\n", lo->get_filename());
     reader_t infor = lo->get_section(DW_sec_info)->get_contents();
-    reader_t abbrevr = lo->get_section(DW_sec_abbrev)->get_contents();
     reader_t liner = lo->get_section(DW_sec_line)->get_contents();
 
+    vector<compile_unit_t*> cus;
     compile_unit_t *cu = 0;
     for (;;)
     {
-	cu = new compile_unit_t(compile_units_.size(), lo);
+	cu = new(arena_.alloc(sizeof(compile_unit_t)))
+		compile_unit_t(compile_units_.size(), lo);
 	if (!cu->read_header(infor))
 	    break;
 
-	cu->read_abbrevs(abbrevr);
+	if (!cu->read_abbrevs())
+	    break;
 
 	if (!cu->read_attributes())
 	    break;
@@ -72,8 +94,43 @@ state_t::read_compile_units(link_object_t *lo)
             break;
 
 	compile_units_.push_back(cu);
+	cus.push_back(cu);
+    }
+    cu->~compile_unit_t();
+    lo->index_compile_units(cus);
+    return read_type_units(lo);
+}
+
+/* Read the type units in .debug_types, which are referred to
+ * from compile units by type signature, and index them by
+ * signature.  The same type can appear in a type unit in
+ * several link objects; the first one wins. */
+bool
+state_t::read_type_units(link_object_t *lo)
+{
+    reader_t typesr = lo->get_section(DW_sec_types)->get_contents();
+    if (!typesr.get_remains())
+	return true;
+
+    unsigned int ntus = 0;
+    compile_unit_t *tu = 0;
+    for (;;)
+    {
+	tu = new(arena_.alloc(sizeof(compile_unit_t)))
+		compile_unit_t(compile_units_.size() + type_units_.size(), lo);
+	if (!tu->read_header(typesr, /*is_type_unit*/true))
+	    break;
+	if (!tu->read_abbrevs())
+	    break;
+	if (!tu->read_attributes())
+	    break;
+	type_units_.push_back(tu);
+	type_unit_index_.insert(make_pair(tu->get_type_signature(), tu));
+	ntus++;
     }
-    delete cu;
+    tu->~compile_unit_t();
+    dprintf("read %u type units for link_object %s\n",
+	    ntus, lo->get_filename());
     return true;
 }
 
@@ -116,6 +173,7 @@ state_t::add_self()
     char *exe = np::spiegel::platform::self_exe();
     bool r = false;
 
+    unsigned int first = link_objects_.size();
     vector<np::spiegel::platform::linkobj_t> los = np::spiegel::platform::get_linkobjs();
     vector<np::spiegel::platform::linkobj_t>::iterator i;
     const char *filename;
@@ -164,10 +222,9 @@ state_t::add_self()
                                           lo);
 	}
     }
+    link_object_index_.build();
 
-    r = read_link_objects();
-    if (r)
-	prepare_address_index();
+    r = read_link_objects(first);
     free(exe);
     return r;
 }
@@ -176,13 +233,14 @@ bool
 state_t::add_executable(const char *filename)
 {
     dprintf("Adding executable %s\n", filename);
-    link_object_t *lo = get_link_object(filename);
-    if (!lo)
-        lo = make_link_object(filename);
-    bool r = read_link_objects();
-    if (r)
-	prepare_address_index();
-    return r;
+    if (get_link_object(filename))
+    {
+	dprintf("already have link object %s\n", filename);
+	return true;
+    }
+    unsigned int first = link_objects_.size();
+    make_link_object(filename);
+    return read_link_objects(first);
 }
 
 link_object_t *
@@ -207,11 +265,17 @@ state_t::make_link_object(const char *filename)
     return lo;
 }
 
+/* Map and read the link objects from index @first onwards, i.e.
+ * the ones added since the last call, then index their functions.
+ * Link objects already read are left alone, so adding objects one
+ * at a time, e.g. as plugins are dlopen()ed, costs only the work
+ * for the new objects. */
 bool
-state_t::read_link_objects()
+state_t::read_link_objects(unsigned int first)
 {
+    unsigned int first_cu = compile_units_.size();
     vector<link_object_t*>::iterator i;
-    for (i = link_objects_.begin() ; i != link_objects_.end() ; ++i)
+    for (i = link_objects_.begin() + first ; i != link_objects_.end() ; ++i)
     {
 	/* TODO: why isn't this in filename_is_ignored() ?? */
 #if HAVE_VALGRIND
@@ -228,7 +292,28 @@ state_t::read_link_objects()
         /* note map_sections() can succeed but result in no sections */
         if ((*i)->has_sections() && !read_compile_units(*i))
 	    return false;
+	/* a usable index file saves walking the compile units */
+	if ((*i)->has_sections())
+	    load_index_file(*i);
+	/* without CFI we can still walk frame pointers */
+	if (!(*i)->read_cfi())
+	    wprintf("cannot unwind stacks using CFI in %s\n",
+		    (*i)->get_filename());
+	if (is_enabled_for(np::log::DEBUG))
+	{
+	    unsigned long mapped, resident;
+	    (*i)->get_mapping_stats(mapped, resident);
+	    dprintf("read %s: %lu bytes mapped, %lu bytes resident\n",
+		    (*i)->get_filename(), mapped, resident);
+	}
     }
+    /* build the CFI tables now, in the parent, so
+     * test children can unwind without allocating */
+    np::spiegel::platform::set_unwinder(unwind_with_cfi);
+    dprintf("DWARF arena: %lu allocations, %lu bytes in %u blocks\n",
+	    arena_.get_nallocs(), (unsigned long)arena_.get_nbytes(),
+	    arena_.get_nblocks());
+    prepare_address_index(first_cu);
     return true;
 }
 
@@ -576,20 +661,28 @@ state_t::dump_abbrevs()
 compile_unit_offset_tuple_t
 state_t::resolve_link_object_reference(const reference_t &ref) const
 {
-    link_object_t *lo = (link_object_t *)ref.resolver;
-    uint64_t off = ref.offset;
-    for (compile_unit_t *cu : compile_units_)
+    const link_object_t *lo = (const link_object_t *)ref.resolver;
+    compile_unit_t *cu = lo->find_compile_unit(ref.offset);
+    if (!cu)
+	return compile_unit_offset_tuple_t(0, 0);
+    return compile_unit_offset_tuple_t(cu, ref.offset - cu->get_start_offset());
+}
+
+reference_t
+state_t::resolve_signature(uint64_t sig) const
+{
+    unordered_map<uint64_t, compile_unit_t*>::const_iterator i =
+	type_unit_index_.find(sig);
+    if (i == type_unit_index_.end())
     {
-        if (lo == cu->get_link_object() &&
-            cu->get_start_offset() <= off &&
-            off < cu->get_end_offset())
-            return compile_unit_offset_tuple_t(cu, off - cu->get_start_offset());
+	dprintf("no type unit for signature 0x%llx\n", (unsigned long long)sig);
+	return reference_t::null;
     }
-    return compile_unit_offset_tuple_t(0, 0);
+    return i->second->make_type_reference();
 }
 
-void
-state_t::insert_ranges(const walker_t &w, reference_t funcref)
+template<class I> void
+state_t::insert_ranges(I &index, const walker_t &w, reference_t ref)
 {
     const entry_t *e = w.get_entry();
     bool has_lo = (e->get_attribute(DW_AT_low_pc) != 0);
@@ -607,13 +700,13 @@ state_t::insert_ranges(const walker_t &w, reference_t funcref)
 	if (w.get_dwarf_version() == 4 &&
 	    e->get_attribute_form(DW_AT_high_pc) != DW_FORM_addr)
 	    hi += lo;
-	address_index_.insert(lo, hi, funcref);
+	index.insert(lo, hi, ref);
     }
     else if (ranges)
     {
 	reader_t r = w.get_section_contents(DW_sec_ranges);
-	r.skip(ranges);
-	np::spiegel::addr_t base = 0; // TODO: compile unit base
+	r.skip(ranges + w.get_compile_unit()->get_ranges_base());
+	np::spiegel::addr_t base = w.get_compile_unit()->get_low_pc();
 	np::spiegel::addr_t start, end;
 	for (;;)
 	{
@@ -630,28 +723,313 @@ state_t::insert_ranges(const walker_t &w, reference_t funcref)
 	    }
 	    start += base;
 	    end += base;
-	    address_index_.insert(start, end, funcref);
+	    index.insert(start, end, ref);
 	}
     }
     else if (has_lo)
     {
-	address_index_.insert(lo, funcref);
+	index.insert(lo, ref);
+    }
+}
+
+void
+state_t::prepare_address_index(unsigned int first)
+{
+    /* A compile unit covered by .debug_aranges can be found from
+     * an address without walking its DIEs, so indexing its functions
+     * is left until an address in it is first described.  Programs
+     * whose tests all pass then never pay for it. */
+    vector<bool> covered(compile_units_.size());
+    link_object_t *lo = 0;
+    for (unsigned int i = first ; i < compile_units_.size() ; i++)
+    {
+	compile_unit_t *cu = compile_units_[i];
+	if (cu->get_link_object() != lo)
+	{
+	    lo = cu->get_link_object();
+	    if (!lo->has_index_file())
+		read_aranges(lo, covered);
+	}
+	if (!cu->is_indexed() && !covered[cu->get_index()])
+	{
+	    index_compile_unit(cu, address_index_, inline_index_);
+	    cu->set_indexed(true);
+	}
     }
+    cu_index_.build();
+    address_index_.build();
+    inline_index_.build();
 }
 
+/* Add the address ranges in the .debug_aranges section of @lo to
+ * the index from addresses to compile units, and flag in @covered
+ * the compile units which have any. */
 void
-state_t::prepare_address_index()
+state_t::read_aranges(link_object_t *lo, vector<bool> &covered)
+{
+    reader_t r = lo->get_section(DW_sec_aranges)->get_contents();
+    unsigned int nranges = 0;
+    while (r.get_remains())
+    {
+	np::spiegel::offset_t length;
+	bool is64;
+	if (!r.read_initial_length(length, is64))
+	    break;
+	reader_t sr = r.initial_subset(length);
+	sr.set_is64(is64);
+	r.skip(length);
+
+	uint16_t version;
+	np::spiegel::offset_t cuoff;
+	uint8_t addrsize, segsize;
+	if (!sr.read_u16(version) ||
+	    !sr.read_offset(cuoff) ||
+	    !sr.read_u8(addrsize) ||
+	    !sr.read_u8(segsize))
+	    break;
+	if (version != 2 || addrsize != _NP_ADDRSIZE || segsize != 0)
+	{
+	    dprintf("skipping .debug_aranges set with version %u "
+		    "addrsize %u segsize %u\n", version, addrsize, segsize);
+	    continue;
+	}
+	compile_unit_t *cu = lo->find_compile_unit(cuoff);
+	if (!cu)
+	    continue;
+
+	/* the tuples are aligned to twice the address size
+	 * from the start of the set, including its length */
+	unsigned long hlen = (is64 ? 12 : 4) + sr.get_offset();
+	unsigned long align = 2 * _NP_ADDRSIZE;
+	sr.skip((align - hlen % align) % align);
+
+	np::spiegel::addr_t start, len;
+	while (sr.read_addr(start) && sr.read_addr(len))
+	{
+	    /* (0,0) marks the end of the set */
+	    if (!start && !len)
+		break;
+	    if (!len)
+		continue;
+	    cu_index_.insert(start, start + len, cu);
+	    covered[cu->get_index()] = true;
+	    nranges++;
+	}
+    }
+    dprintf("read %u address ranges from .debug_aranges in %s\n",
+	    nranges, lo->get_filename());
+}
+
+/* If the compile unit covering @addr hasn't had its functions
+ * indexed yet, index them now.  Returns true if it did. */
+bool
+state_t::index_address(np::spiegel::addr_t addr)
+{
+    compile_unit_t * const *cup = cu_index_.find(addr);
+    if (!cup || (*cup)->is_indexed())
+	return false;
+    index_compile_unit(*cup, address_index_, inline_index_);
+    (*cup)->set_indexed(true);
+    address_index_.build();
+    inline_index_.build();
+    return true;
+}
+
+/* Index the functions of every compile unit not indexed yet in the
+ * link object containing the recorded address @addr.  The
+ * .debug_aranges section isn't required to cover every function, so
+ * this is the fallback before giving up on an address.  Objects which
+ * were read but aren't loaded can't be told apart by address, so for
+ * an address outside every loaded object they're all candidates.
+ * Returns true if there were any such compile units. */
+bool
+state_t::index_remaining(np::spiegel::addr_t addr)
 {
+    link_object_t *owner = 0;
+    for (link_object_t *lo : link_objects_)
+    {
+	link_object_t * const *lop = link_object_index_.find(lo->live_address(addr));
+	if (lop && *lop == lo)
+	{
+	    owner = lo;
+	    break;
+	}
+    }
+    if (owner && !owner->get_compile_units().size())
+	return false;
+
+    bool any = false;
     for (compile_unit_t *cu : compile_units_)
     {
-	walker_t w(cu);
-	w.set_filter_tag(DW_TAG_subprogram);
-	while (const entry_t *e = w.move_preorder())
+	if (cu->is_indexed())
+	    continue;
+	link_object_t *lo = cu->get_link_object();
+	if (owner ? (lo != owner) : lo->has_system_mappings())
+	    continue;
+	index_compile_unit(cu, address_index_, inline_index_);
+	cu->set_indexed(true);
+	any = true;
+    }
+    if (any)
+    {
+	address_index_.build();
+	inline_index_.build();
+    }
+    return any;
+}
+
+/* Insert the address ranges of every function in @cu into
+ * @functions and of every inlined function into @inlines. */
+template<class I> void
+state_t::index_compile_unit(compile_unit_t *cu, I &functions, I &inlines)
+{
+    walker_t w(cu);
+    w.set_filter_tag(DW_TAG_subprogram, DW_TAG_inlined_subroutine);
+    while (const entry_t *e = w.move_preorder())
+    {
+	if (e->get_tag() == DW_TAG_subprogram)
+	    insert_ranges(functions, w, w.get_reference());
+	else
+	    insert_ranges(inlines, w, w.get_reference());
+    }
+}
+
+/* Collects address ranges for an index file, in place of
+ * a range_index of references when indexing a compile unit. */
+struct range_collector_t
+{
+    range_collector_t(index_file_t::index_t &index, uint32_t cu)
+     :  index_(index), cu_(cu)
+    {}
+
+    void insert(addr_t lo, addr_t hi, reference_t ref)
+    {
+	index_.insert(lo, hi, index_file_t::make_value(cu_, ref.offset));
+    }
+    void insert(addr_t x, reference_t ref) { insert(x, x, ref); }
+
+    index_file_t::index_t &index_;
+    uint32_t cu_;
+};
+
+/* Use the index file for @lo, if there's one which matches, in
+ * place of indexing its compile units.  The mapping is kept by
+ * @lo and searched by find_indexed(). */
+bool
+state_t::load_index_file(link_object_t *lo)
+{
+    index_file_t *idx = new index_file_t;
+    if (!idx->map(lo->get_filename(), lo->get_build_id(),
+		  lo->get_section(DW_sec_info)->get_size()))
+    {
+	delete idx;
+	return false;
+    }
+
+    const vector<compile_unit_t*> &cus = lo->get_compile_units();
+    bool stale = (idx->get_ncus() != cus.size());
+    for (uint32_t i = 0 ; !stale && i < cus.size() ; i++)
+	stale = (idx->get_cu_offsets()[i] != cus[i]->get_start_offset());
+    if (stale)
+    {
+	dprintf("index file for %s doesn't match its compile units, ignoring\n",
+		lo->get_filename());
+	delete idx;
+	return false;
+    }
+
+    for (compile_unit_t *cu : cus)
+	cu->set_indexed(true);
+    dprintf("loaded index file for %s: %u functions, %u inlines\n",
+	    lo->get_filename(), idx->get_functions().size(),
+	    idx->get_inlines().size());
+    lo->set_index_file(idx);
+    nindex_files_++;
+    return true;
+}
+
+/* Search the functions, or if @inlines the inlined subroutines, in
+ * the index files of all link objects for the recorded address @addr,
+ * returning the DIE and optionally the start of its range. */
+bool
+state_t::find_indexed(np::spiegel::addr_t addr, bool inlines,
+		      reference_t &ref, np::spiegel::addr_t *lop) const
+{
+    if (!nindex_files_)
+	return false;
+    for (link_object_t *lo : link_objects_)
+    {
+	const index_file_t *idx = lo->get_index_file();
+	if (!idx)
+	    continue;
+	const index_file_t::index_t &index =
+		(inlines ? idx->get_inlines() : idx->get_functions());
+	uint64_t start;
+	const uint64_t *v = index.find(addr, &start);
+	if (!v)
+	    continue;
+	const vector<compile_unit_t*> &cus = lo->get_compile_units();
+	uint32_t cu = index_file_t::value_cu(*v);
+	if (cu >= cus.size())
+	    return false;	/* corrupt index file */
+	ref = cus[cu]->make_reference(index_file_t::value_offset(*v));
+	if (lop)
+	    *lop = start;
+	return true;
+    }
+    return false;
+}
+
+/* Write an index file for the executable and for each other link
+ * object with DWARF information whose directory we own, for later
+ * runs to load instead of walking the compile units.  Only failing
+ * to write the executable's index is an error. */
+bool
+state_t::write_index_files() const
+{
+    bool r = true;
+    char *exe = np::spiegel::platform::self_exe();
+    for (link_object_t *lo : link_objects_)
+    {
+	const vector<compile_unit_t*> &cus = lo->get_compile_units();
+	if (!cus.size())
+	    continue;
+	bool is_exe = (exe && !strcmp(lo->get_filename(), exe));
+	if (!is_exe)
 	{
-	    assert(e->get_tag() == DW_TAG_subprogram);
-	    insert_ranges(w, w.get_reference());
+	    np::util::filename_t dir(lo->get_filename());
+	    dir.pop_back();
+	    if (filename_is_ignored(lo->get_filename()) ||
+		dir == lo->get_filename() ||
+		access(dir.c_str(), W_OK) < 0)
+	    {
+		dprintf("not writing index file for %s\n", lo->get_filename());
+		continue;
+	    }
+	}
+	vector<uint64_t> cu_offsets;
+	index_file_t::index_t functions, inlines;
+	for (uint32_t i = 0 ; i < cus.size() ; i++)
+	{
+	    cu_offsets.push_back(cus[i]->get_start_offset());
+	    range_collector_t fc(functions, i), ic(inlines, i);
+	    index_compile_unit(cus[i], fc, ic);
+	}
+	functions.build();
+	inlines.build();
+	if (!index_file_t::write(lo->get_filename(), lo->get_build_id(),
+				 lo->get_section(DW_sec_info)->get_size(),
+				 cu_offsets, functions, inlines))
+	{
+	    if (is_exe)
+		r = false;
+	    else
+		dprintf("failed to write index file for %s, skipping\n",
+			lo->get_filename());
 	}
     }
+    free(exe);
+    return r;
 }
 
 bool
@@ -678,8 +1056,8 @@ state_t::is_within(np::spiegel::addr_t addr, const walker_t &w,
     if (ranges)
     {
 	reader_t r = w.get_section_contents(DW_sec_ranges);
-	r.skip(ranges);
-	np::spiegel::addr_t base = 0; // TODO: compile unit base
+	r.skip(ranges + w.get_compile_unit()->get_ranges_base());
+	np::spiegel::addr_t base = w.get_compile_unit()->get_low_pc();
 	np::spiegel::addr_t start, end;
 	for (;;)
 	{
@@ -730,12 +1108,21 @@ state_t::instrumentable_address(np::spiegel::addr_t addr) const
 np::spiegel::addr_t
 state_t::recorded_address(np::spiegel::addr_t addr) const
 {
-    np::util::rangetree<addr_t, link_object_t*>::const_iterator i = link_object_index_.find(addr);
-    if (i != link_object_index_.end())
-        return i->second->recorded_address(addr);
+    link_object_t * const *lop = link_object_index_.find(addr);
+    if (lop)
+        return (*lop)->recorded_address(addr);
     return addr;
 }
 
+bool
+state_t::unwind_frame(np::spiegel::platform::frame_t &frame) const
+{
+    link_object_t * const *lop = link_object_index_.find(frame.pc);
+    if (!lop)
+	return false;
+    return (*lop)->get_cfi().unwind(frame);
+}
+
 bool
 state_t::describe_address(np::spiegel::addr_t addr,
 			  reference_t &curef,
@@ -747,13 +1134,20 @@ state_t::describe_address(np::spiegel::addr_t addr,
     funcref = reference_t::null;
     offset = 0;
 
-    if (address_index_.size())
+    if (address_index_.size() || cu_index_.size() || nindex_files_)
     {
-	np::util::rangetree<addr_t, reference_t>::const_iterator i = address_index_.find(addr);
-	if (i == address_index_.end())
+	/* functions are indexed lazily, see prepare_address_index() */
+	state_t *self = const_cast<state_t*>(this);
+	self->index_address(addr);
+	addr_t lo;
+	const reference_t *ref = address_index_.find(addr, &lo);
+	if (!ref && self->index_remaining(addr))
+	    ref = address_index_.find(addr, &lo);
+	if (ref)
+	    funcref = *ref;
+	else if (!find_indexed(addr, false, funcref, &lo))
 	    return false;
-	offset = addr - i->first.lo;
-	funcref = i->second;
+	offset = addr - lo;
 	return true;
     }
 
@@ -789,6 +1183,38 @@ state_t::describe_address(np::spiegel::addr_t addr,
     return false;
 }
 
+void
+state_t::describe_inlines(np::spiegel::addr_t addr,
+			  vector<inline_t> &inlines) const
+{
+    inlines.clear();
+    const_cast<state_t*>(this)->index_address(addr);
+    reference_t ref = reference_t::null;
+    const reference_t *refp = inline_index_.find(addr);
+    if (refp)
+	ref = *refp;
+    else if (!find_indexed(addr, true, ref, 0))
+	return;
+
+    /* The innermost inlined subroutine's ancestors up to the
+     * enclosing subprogram are the rest of the chain */
+    walker_t w(ref);
+    compile_unit_t *cu = ref.resolve()._cu;
+    for (const entry_t *e = w.move_next() ;
+	 e && e->get_tag() != DW_TAG_subprogram ;
+	 e = w.move_up())
+    {
+	if (e->get_tag() != DW_TAG_inlined_subroutine)
+	    continue;	// e.g. DW_TAG_lexical_block
+	inline_t in;
+	in.funcref = e->get_reference_attribute(DW_AT_abstract_origin);
+	in.call_filename = cu->get_source_filename(
+				e->get_uint32_attribute(DW_AT_call_file));
+	in.call_line = e->get_uint32_attribute(DW_AT_call_line);
+	inlines.push_back(in);
+    }
+}
+
 string
 state_t::get_full_name(reference_t ref)
 {
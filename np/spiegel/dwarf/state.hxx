@@ -18,13 +18,16 @@
 
 #include "np/spiegel/common.hxx"
 #include "np/spiegel/spiegel.hxx"
-#include "np/util/rangetree.hxx"
+#include "np/util/range_index.hxx"
+#include "np/util/arena.hxx"
 #include "section.hxx"
 #include "reference.hxx"
 #include "enumerations.hxx"
+#include <unordered_map>
 
 namespace np {
 namespace spiegel {
+namespace platform { struct frame_t; };
 namespace dwarf {
 
 class walker_t;
@@ -39,6 +42,7 @@ public:
 
     bool add_self();
     bool add_executable(const char *filename);
+    bool write_index_files() const;
 
     void dump_structs();
     void dump_functions();
@@ -65,25 +69,64 @@ public:
 			  unsigned int &offset) const;
     std::string get_full_name(reference_t ref);
 
+    /* A function inlined into another at some address, and the
+     * source location of the call which was inlined. */
+    struct inline_t
+    {
+	reference_t funcref;
+	np::util::filename_t call_filename;
+	uint32_t call_line;
+    };
+    /* Input is a recorded address.  Returns in @inlines the chain of
+     * functions inlined at that address, innermost first, not
+     * including the function described by describe_address(). */
+    void describe_inlines(np::spiegel::addr_t addr,
+			  std::vector<inline_t> &inlines) const;
+
+    /* Replace @frame with its caller's frame using the Call Frame
+     * Information of the link object containing @frame's pc.  Used
+     * by the platform stack unwinder; doesn't allocate memory. */
+    bool unwind_frame(np::spiegel::platform::frame_t &frame) const;
+
     // state_t is a Singleton
     static state_t *instance() { return instance_; }
 
     const std::vector<compile_unit_t*> &get_compile_units() const { return compile_units_; }
 
     compile_unit_offset_tuple_t resolve_link_object_reference(const reference_t &ref) const;
+    /* Returns a reference to the type described by the type unit
+     * with signature @sig, e.g. from a DW_FORM_ref_sig8 attribute,
+     * or reference_t::null if there is no such type unit. */
+    reference_t resolve_signature(uint64_t sig) const;
 
     const std::vector<link_object_t*> &get_link_objects() const { return link_objects_; }
     link_object_t *get_link_object(uint32_t loidx) const { return loidx < link_objects_.size() ? link_objects_[loidx] : 0; }
     link_object_t *get_link_object(const char *filename) const;
 
+    /* Long-lived DWARF-side objects (compile units, abbrev tables,
+     * line number programs and their indexes) are allocated from
+     * this arena and released together when the state_t goes. */
+    np::util::arena_t &get_arena() { return arena_; }
+
 private:
-    bool read_link_objects();
+    bool read_link_objects(unsigned int first);
     link_object_t *make_link_object(const char *filename);
     bool read_compile_units(link_object_t *);
-    /* Prepare an index which will speed up all later calls to describe_address(). */
-    void prepare_address_index();
-
-    void insert_ranges(const walker_t &w, reference_t funcref);
+    bool read_type_units(link_object_t *);
+    /* Add the compile units from index @first onwards to the index
+     * which speeds up all later calls to describe_address(). */
+    void prepare_address_index(unsigned int first);
+    void read_aranges(link_object_t *, std::vector<bool> &covered);
+    bool index_address(np::spiegel::addr_t addr);
+    bool index_remaining(np::spiegel::addr_t addr);
+
+    template<class I> static void insert_ranges(I &index, const walker_t &w,
+						reference_t ref);
+    template<class I> static void index_compile_unit(compile_unit_t *cu,
+						     I &functions, I &inlines);
+    bool load_index_file(link_object_t *);
+    bool find_indexed(np::spiegel::addr_t addr, bool inlines,
+		      reference_t &ref, np::spiegel::addr_t *lop) const;
     bool is_within(np::spiegel::addr_t addr, const walker_t &w,
 		   unsigned int &offset) const;
 
@@ -91,9 +134,24 @@ private:
 
     std::vector<link_object_t*> link_objects_;
     std::vector<compile_unit_t*> compile_units_;
-    np::util::rangetree<addr_t, reference_t> address_index_;
+    /* DWARF 4 type units from .debug_types, which aren't
+     * compile units as far as the rest of Spiegel is concerned,
+     * indexed by type signature */
+    std::vector<compile_unit_t*> type_units_;
+    std::unordered_map<uint64_t, compile_unit_t*> type_unit_index_;
+    np::util::range_index<addr_t, reference_t> address_index_;
+    /* Index from recorded address ranges to DW_TAG_inlined_subroutine */
+    np::util::range_index<addr_t, reference_t> inline_index_;
+    /* Index from recorded address ranges to the compile units whose
+     * functions aren't in address_index_ until first needed, from
+     * .debug_aranges */
+    np::util::range_index<addr_t, compile_unit_t*> cu_index_;
     /* Index from real address ranges to link_object_t */
-    np::util::rangetree<addr_t, link_object_t*> link_object_index_;
+    np::util::range_index<addr_t, link_object_t*> link_object_index_;
+    /* Number of link objects whose functions are found from
+     * their mapped index file rather than address_index_ */
+    unsigned int nindex_files_;
+    np::util::arena_t arena_;
 
     friend class walker_t;
     friend class compile_unit_t;
@@ -13,6 +13,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <algorithm>
 #include "walker.hxx"
 #include "enumerations.hxx"
 #include "link_object.hxx"
@@ -44,8 +45,12 @@ walker_t::seek(reference_t ref)
     level_ = 0;
 }
 
+/* Read the next entry.  If @skipping is true the caller
+ * doesn't care about this entry or any of its descendants, so
+ * we don't decode any attributes and where possible we use the
+ * DW_AT_sibling attribute to jump over the entire subtree. */
 int
-walker_t::read_entry()
+walker_t::read_entry(bool skipping)
 {
     /* Refs are offsets relative to the start of the
      * compile unit header, but the reader starts
@@ -78,16 +83,26 @@ walker_t::read_entry()
 
     int r = RE_OK;
 
-    if (filter_tag_ && a->tag != filter_tag_)
+    if (skipping ||
+	(filter_tag_ && a->tag != filter_tag_ && a->tag != filter_tag2_))
     {
 	entry_.partial_setup(offset, level_, a);
-	r = skip_attributes();
+	uint64_t sibling = 0;
+	r = skip_attributes(skipping ? &sibling : 0);
 	if (r == RE_OK)
 	    r = RE_FILTERED;
+	if (r == RE_FILTERED && a->children &&
+	    sibling > reader_.get_offset() &&
+	    reader_.seek(sibling))
+	{
+	    // jumped over all the children, so the
+	    // next entry is at the same level as this one
+	    return r;
+	}
     }
     else
     {
-	entry_.setup(offset, level_, a);
+	entry_.setup(offset, level_, a, compile_unit_);
 	r = read_attributes();
     }
 
@@ -106,230 +121,71 @@ walker_t::read_entry()
     return r;
 }
 
+/* Record where each attribute of the current entry is stored.
+ * The values are decoded later, on demand, by the entry_t. */
 int
 walker_t::read_attributes()
+{
+    return skip_attributes(0, /*record*/true);
+}
+
+/* Skip over the attributes of the current entry without decoding
+ * them.  If @siblingp is not NULL, the value of any DW_AT_sibling
+ * attribute which is a reference within the compile unit is stored
+ * there.  If @record is true, the offset of each attribute is
+ * recorded in the entry. */
+int
+walker_t::skip_attributes(uint64_t *siblingp, bool record)
 {
     const abbrev_t *a = entry_.get_abbrev();
-    vector<abbrev_t::attr_spec_t>::const_iterator i;
+    if (a->fixed_size && !record && !(siblingp && a->has_sibling))
+    {
+	uint32_t size = a->get_fixed_size(compile_unit_->get_version(),
+					  compile_unit_->get_offset_size());
+	return (reader_.skip(size) ? RE_OK : RE_EOF);
+    }
+
+    const abbrev_t::attr_spec_t *i;
     for (i = a->attr_specs.begin() ; i != a->attr_specs.end() ; ++i)
     {
-	switch (i->form)
+	if (record)
+	    entry_.add_attribute(i->name, i->form, reader_.get_offset());
+	if (siblingp && i->name == DW_AT_sibling)
 	{
-	case DW_FORM_data1:
-	    {
-		uint8_t v;
-		if (!reader_.read_u8(v))
-		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_uint32(v));
-		break;
-	    }
-	case DW_FORM_data2:
-	    {
-		uint16_t v;
-		if (!reader_.read_u16(v))
-		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_uint32(v));
-		break;
-	    }
-	case DW_FORM_data4:
-	    {
-		uint32_t v;
-		if (!reader_.read_u32(v))
-		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_uint32(v));
-		break;
-	    }
-	case DW_FORM_data8:
-	case DW_FORM_ref_sig8:
-	    {
-		uint64_t v;
-		if (!reader_.read_u64(v))
-		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_uint64(v));
-		break;
-	    }
-	case DW_FORM_udata:
-	    {
-		uint32_t v;
-		if (!reader_.read_uleb128(v))
-		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_uint32(v));
-		break;
-	    }
-	case DW_FORM_sdata:
+	    switch (i->form)
 	    {
-		int32_t v;
-		if (!reader_.read_sleb128(v))
-		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_sint32(v));
-		break;
-	    }
-	case DW_FORM_addr:
-	    {
-		np::spiegel::addr_t v;
-		if (!reader_.read_addr(v))
-		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_addr(v));
-		break;
-	    }
-	case DW_FORM_flag:
-	    {
-		uint8_t v;
-		if (!reader_.read_u8(v))
-		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_uint32(v));
-		break;
-	    }
-	case DW_FORM_ref1:
-	    {
-		uint8_t off;
-		if (!reader_.read_u8(off))
-		    return RE_EOF;
-		entry_.add_attribute(i->name,
-			value_t::make_ref(compile_unit_->make_reference(off)));
-		break;
-	    }
-	case DW_FORM_ref2:
-	    {
-		uint16_t off;
-		if (!reader_.read_u16(off))
-		    return RE_EOF;
-		entry_.add_attribute(i->name,
-			value_t::make_ref(compile_unit_->make_reference(off)));
-		break;
-	    }
-	case DW_FORM_ref4:
-	    {
-		uint32_t off;
-		if (!reader_.read_u32(off))
-		    return RE_EOF;
-		entry_.add_attribute(i->name,
-			value_t::make_ref(compile_unit_->make_reference(off)));
-		break;
-	    }
-	case DW_FORM_ref8:
-	    {
-		uint64_t off;
-		if (!reader_.read_u64(off))
-		    return RE_EOF;
-		// TODO: detect truncation
-		entry_.add_attribute(i->name,
-			value_t::make_ref(compile_unit_->make_reference(off)));
-		break;
-	    }
-	case DW_FORM_ref_addr:
-	    {
-                // Note that DW_FORM_ref_addr is poorly named in the
-                // standard, it's actually encoded as a file offset
-                // which will be 4B or 8B depending on the file format
-		np::spiegel::offset_t off = 0;
-		if (!reader_.read_offset(off))
-		    return RE_EOF;
-		entry_.add_attribute(i->name,
-                        value_t::make_ref(compile_unit_->get_link_object()->make_reference(off)));
-		break;
-	    }
-	case DW_FORM_string:
-	    {
-		const char *v;
-		if (!reader_.read_string(v))
-		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_string(v));
-		break;
-	    }
-	case DW_FORM_strp:
-	    {
-		np::spiegel::offset_t off;
-		if (compile_unit_->get_version() == 2)
+	    case DW_FORM_ref1:
 		{
-		    uint32_t o32;
-		    if (!reader_.read_u32(o32))
+		    uint8_t off;
+		    if (!reader_.read_u8(off))
 			return RE_EOF;
-		    off = o32;
+		    *siblingp = off;
+		    continue;
 		}
-		else
+	    case DW_FORM_ref2:
 		{
-		    if (!reader_.read_offset(off))
+		    uint16_t off;
+		    if (!reader_.read_u16(off))
 			return RE_EOF;
+		    *siblingp = off;
+		    continue;
 		}
-		const char *v = compile_unit_->get_section(DW_sec_str)->offset_as_string(off);
-		if (!v)
-		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_string(v));
-		break;
-	    }
-	case DW_FORM_block1:
-	    {
-		uint8_t len;
-		const unsigned char *v;
-		if (!reader_.read_u8(len) ||
-		    !reader_.read_bytes(v, len))
-		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_bytes(v, len));
-		break;
-	    }
-	case DW_FORM_block2:
-	    {
-		uint16_t len;
-		const unsigned char *v;
-		if (!reader_.read_u16(len) ||
-		    !reader_.read_bytes(v, len))
-		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_bytes(v, len));
-		break;
-	    }
-	case DW_FORM_block4:
-	    {
-		uint32_t len;
-		const unsigned char *v;
-		if (!reader_.read_u32(len) ||
-		    !reader_.read_bytes(v, len))
-		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_bytes(v, len));
-		break;
-	    }
-	case DW_FORM_block:
-	case DW_FORM_exprloc:
-	    {
-		uint32_t len;
-		const unsigned char *v;
-		if (!reader_.read_uleb128(len) ||
-		    !reader_.read_bytes(v, len))
-		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_bytes(v, len));
-		break;
-	    }
-	case DW_FORM_sec_offset:
-	    {
-		np::spiegel::offset_t v;
-		if (!reader_.read_offset(v))
+	    case DW_FORM_ref4:
+		{
+		    uint32_t off;
+		    if (!reader_.read_u32(off))
+			return RE_EOF;
+		    *siblingp = off;
+		    continue;
+		}
+	    case DW_FORM_ref8:
+		if (!reader_.read_u64(*siblingp))
 		    return RE_EOF;
-		entry_.add_attribute(i->name, value_t::make_offset(v));
-		break;
+		continue;
 	    }
-	case DW_FORM_flag_present:
-	    /* This form has no representation in the attribute
-	     * stream, it's always true.  Presumably this is
-	     * useful in combination with a careful choice of
-	     * abbrevs. */
-	    entry_.add_attribute(i->name, value_t::make_uint32(true));
-	    break;
-	default:
-	    // TODO: bad DWARF info - throw an exception
-	    fatal("Can't handle %s at %s:%d\n",
-		  formvals.to_name(i->form), __FILE__, __LINE__);
+	    // any other form is skipped below
 	}
-    }
-    return RE_OK;
-}
 
-int
-walker_t::skip_attributes()
-{
-    const abbrev_t *a = entry_.get_abbrev();
-    vector<abbrev_t::attr_spec_t>::const_iterator i;
-    for (i = a->attr_specs.begin() ; i != a->attr_specs.end() ; ++i)
-    {
 	switch (i->form)
 	{
 	case DW_FORM_data1:
@@ -349,6 +205,8 @@ walker_t::skip_attributes()
 		return EOF;
 	    break;
 	case DW_FORM_udata:
+	case DW_FORM_GNU_addr_index:
+	case DW_FORM_GNU_str_index:
 	    if (!reader_.skip_uleb128())
 		return EOF;
 	    break;
@@ -434,13 +292,15 @@ walker_t::skip_attributes()
 	    }
 	    break;
 	case DW_FORM_sec_offset:
-	    reader_.skip_offset();
+	    if (!reader_.skip_offset())
+		return EOF;
 	    break;
 	case DW_FORM_flag_present:
 	    /* Nothing to skip */
 	    break;
 	case DW_FORM_ref_sig8:
-	    reader_.skip_u64();
+	    if (!reader_.skip_u64())
+		return EOF;
 	    break;
 	default:
 	    // TODO: bad DWARF info - throw an exception
@@ -455,26 +315,14 @@ walker_t::skip_attributes()
 vector<reference_t>
 walker_t::get_path() const
 {
-    walker_t w2(compile_unit_);
     vector<reference_t> path;
-
-    for (;;)
+    uint32_t off = entry_.get_offset();
+    while (off)
     {
-	int r = w2.read_entry();
-	if (r == RE_EOF)
-	    break;
-	if (r == RE_EOL)
-	{
-	    path.pop_back();
-	    continue;
-	}
-	// treat RE_FILTERED like RE_OK
-	path.push_back(w2.get_reference());
-	if (get_reference() == w2.get_reference())
-	    break;
-	if (!w2.entry_.has_children())
-	    path.pop_back();
+	path.push_back(compile_unit_->make_reference(off));
+	off = compile_unit_->get_parent_offset(off);
     }
+    reverse(path.begin(), path.end());
     return path;
 }
 
@@ -531,7 +379,8 @@ walker_t::move_next()
 				     target_level-1);
 	    RETURN(0);
 	}
-	r = read_entry();
+	// descendants of the current entry are of no interest
+	r = read_entry(/*skipping*/level_ > target_level);
 	if (r == RE_EOF)
 	    RETURN(0);
 	if (r == RE_OK && entry_.get_level() == target_level)
@@ -562,10 +411,10 @@ walker_t::move_to(reference_t ref)
 const entry_t *
 walker_t::move_up()
 {
-    vector<reference_t> path = get_path();
-    if (path.size() > 1)
-	return move_to(path[path.size()-2]);
-    return 0;
+    uint32_t parent = compile_unit_->get_parent_offset(entry_.get_offset());
+    if (!parent)
+	return 0;
+    return move_to(compile_unit_->make_reference(parent));
 }
 
 #undef BEGIN
@@ -33,7 +33,8 @@ public:
 	compile_unit_(cu),
 	reader_(cu->get_contents()),
 	level_(0),
-	filter_tag_(0)
+	filter_tag_(0),
+	filter_tag2_(0)
     {
     }
 
@@ -44,7 +45,8 @@ public:
 	// Note: we don't clone the entry, on the assumption
 	// that it's about to be clobbered anyway
 	level_(o.level_),
-	filter_tag_(o.filter_tag_)
+	filter_tag_(o.filter_tag_),
+	filter_tag2_(o.filter_tag2_)
     {
 	// but we need the entry's level for the move
 	// operations to work correctly
@@ -53,7 +55,8 @@ public:
 
     walker_t(reference_t ref)
      :  id_(next_id_++),
-	filter_tag_(0)
+	filter_tag_(0),
+	filter_tag2_(0)
     {
 	seek(ref);
     }
@@ -80,8 +83,14 @@ public:
     const entry_t *move_up();
 
     uint16_t get_dwarf_version() const { return compile_unit_->get_version(); }
+    compile_unit_t *get_compile_unit() const { return compile_unit_; }
 
-    void set_filter_tag(unsigned tag) { filter_tag_ = tag; }
+    // only return entries with the given tag, or either of two tags
+    void set_filter_tag(unsigned tag, unsigned tag2 = 0)
+    {
+	filter_tag_ = tag;
+	filter_tag2_ = tag2;
+    }
 
     np::spiegel::addr_t live_address(np::spiegel::addr_t addr) const
     {
@@ -98,9 +107,9 @@ private:
     };
 
     void seek(reference_t ref);
-    int read_entry();
+    int read_entry(bool skipping = false);
     int read_attributes();
-    int skip_attributes();
+    int skip_attributes(uint64_t *siblingp = 0, bool record = false);
 
     // for debugging only
     static uint32_t next_id_;
@@ -111,6 +120,7 @@ private:
     entry_t entry_;
     unsigned level_;
     unsigned filter_tag_;
+    unsigned filter_tag2_;
 };
 
 
@@ -67,6 +67,34 @@ extern std::vector<linkobj_t> get_linkobjs();
 bool is_plt_section(const char *secname);
 np::spiegel::addr_t follow_plt(np::spiegel::addr_t);
 
+// A section with contents in an object file.  If @compressed,
+// @offset and @size describe a zlib stream which inflates to
+// @uncompressed_size bytes, and @name is the name of the section
+// as if it were not compressed, e.g. .debug_info for .zdebug_info.
+struct file_section_t
+{
+    std::string name;
+    unsigned long offset;
+    unsigned long size;
+    bool compressed;
+    unsigned long uncompressed_size;
+};
+/* Read the section headers of the object file @filename directly,
+ * which is much cheaper than opening it with BFD.  Returns false
+ * if the file isn't in the platform's native format, in which case
+ * the caller can fall back to BFD. */
+extern bool get_file_sections(const char *filename,
+			      std::vector<file_section_t> &sections);
+/* Fetch the GNU build-id of the object file @filename, whose
+ * @sections were read by get_file_sections(), as raw bytes.
+ * Returns false if it doesn't have one. */
+extern bool get_build_id(const char *filename,
+			 const std::vector<file_section_t> &sections,
+			 std::string &build_id);
+/* How many bytes of the pages spanning @addr..@addr+@len are
+ * resident in memory, e.g. because they were touched or prefetched. */
+extern unsigned long resident_bytes(const void *addr, unsigned long len);
+
 // extern np::spiegel::value_t invoke(void *fnaddr, vector<np::spiegel::value_t> args);
 
 /*
@@ -123,6 +151,27 @@ extern bool is_intercept_installed(np::spiegel::addr_t,
 			     const intstate_t &state);
 
 extern std::vector<np::spiegel::addr_t> get_stacktrace();
+/* Fills @stack with at most @max return addresses, innermost
+ * first, and returns how many.  Doesn't allocate memory, so it's
+ * cheap enough to call for every event in a test child. */
+extern unsigned int get_stacktrace(np::spiegel::addr_t *stack, unsigned int max);
+
+/* The state of one stack frame as seen by get_stacktrace(): an
+ * address within the frame's function, and the values the stack
+ * and frame pointer registers had at that address. */
+struct frame_t
+{
+    np::spiegel::addr_t pc;
+    np::spiegel::addr_t sp;
+    np::spiegel::addr_t bp;
+};
+/* An unwinder replaces @frame with its caller's frame and returns
+ * true, setting pc to 0 if @frame is the outermost.  It returns
+ * false if it knows nothing about @frame, and get_stacktrace()
+ * falls back to following frame pointers.  It's called from test
+ * children so must not allocate memory. */
+typedef bool (*unwinder_t)(frame_t &frame);
+extern void set_unwinder(unwinder_t);
 
 extern bool is_running_under_debugger();
 
@@ -131,7 +180,12 @@ extern std::vector<std::string> get_file_descriptors();
 extern char *current_exception_type();
 extern void cleanup_current_exception();
 
-extern bool symbol_filename(const char *, std::string &);
+/* Find the separate debug file for the object file @filename,
+ * given its @sections and @build_id from get_build_id(). */
+extern bool symbol_filename(const char *filename,
+			    const std::vector<file_section_t> &sections,
+			    const std::string &build_id,
+			    std::string &symfile);
 
 extern char *current_exception_type();
 extern void cleanup_current_exception();
@@ -20,9 +20,11 @@
 #include "np/util/log.hxx"
 #include "common.hxx"
 #include <mach-o/dyld.h>
+#include <mach-o/loader.h>
 #include <mach/mach_time.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dlfcn.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -147,6 +149,77 @@ bool is_plt_section(const char *secname)
 	    !strcmp(secname, "__DATA.__la_symbol_ptr"));
 }
 
+bool get_file_sections(const char *filename __attribute__((unused)),
+		       std::vector<file_section_t> &sections __attribute__((unused)))
+{
+    // Mach-O files are left to BFD
+    return false;
+}
+
+/* The Mach-O equivalent of a GNU build-id is the LC_UUID load
+ * command.  Only thin native-endian objects are handled. */
+bool get_build_id(const char *filename,
+		  const vector<file_section_t> &sections __attribute__((unused)),
+		  std::string &build_id)
+{
+    build_id.clear();
+    int fd = open(filename, O_RDONLY, 0);
+    if (fd < 0)
+	return false;
+
+    struct mach_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    unsigned long off = 0;
+    vector<char> cmds;
+    if (pread(fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr))
+    {
+	if (hdr.magic == MH_MAGIC)
+	    off = sizeof(struct mach_header);
+	else if (hdr.magic == MH_MAGIC_64)
+	    off = sizeof(struct mach_header_64);
+    }
+    if (off)
+    {
+	cmds.resize(hdr.sizeofcmds);
+	if (pread(fd, cmds.data(), cmds.size(), off) != (ssize_t)cmds.size())
+	    cmds.clear();
+    }
+    close(fd);
+
+    unsigned long i = 0;
+    for (uint32_t n = 0 ;
+	 n < hdr.ncmds && i + sizeof(struct load_command) <= cmds.size() ;
+	 n++)
+    {
+	const struct load_command *cmd = (const struct load_command *)(cmds.data() + i);
+	if (cmd->cmdsize < sizeof(struct load_command) ||
+	    i + cmd->cmdsize > cmds.size())
+	    break;
+	if (cmd->cmd == LC_UUID && cmd->cmdsize >= sizeof(struct uuid_command))
+	{
+	    const struct uuid_command *uc = (const struct uuid_command *)cmd;
+	    build_id.assign((const char *)uc->uuid, sizeof(uc->uuid));
+	    break;
+	}
+	i += cmd->cmdsize;
+    }
+    return build_id.length() > 0;
+}
+
+unsigned long resident_bytes(const void *addr, unsigned long len)
+{
+    unsigned long pagesize = getpagesize();
+    unsigned long start = (unsigned long)addr & ~(pagesize-1);
+    unsigned long npages = ((unsigned long)addr + len - start + pagesize-1) / pagesize;
+    vector<char> vec(npages);
+    if (!npages || mincore((void *)start, npages * pagesize, vec.data()) < 0)
+	return 0;
+    unsigned long n = 0;
+    for (char v : vec)
+	n += (v & MINCORE_INCORE);
+    return n * pagesize;
+}
+
 np::spiegel::addr_t follow_plt(np::spiegel::addr_t addr)
 {
     /* Note: this is identical to the Linux implementation,
@@ -385,7 +458,10 @@ int clock_gettime(int clk_id, struct timespec *res)
     return -1;
 }
 
-bool symbol_filename(const char *filename, std::string &symfile)
+bool symbol_filename(const char *filename,
+		     const vector<file_section_t> &sections __attribute__((unused)),
+		     const std::string &build_id __attribute__((unused)),
+		     std::string &symfile)
 {
     filename_t path = filename;
     filename_t base = path.basename();
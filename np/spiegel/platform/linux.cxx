@@ -21,11 +21,19 @@
 
 #include <dlfcn.h>
 #include <link.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <signal.h>
 #include <memory.h>
 #include <sys/ucontext.h>
 #include <ucontext.h>
 #include "np/util/valgrind.h"
+#include "np/util/filename.hxx"
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
 #include <dirent.h>
 #include <ctype.h>
 #include <typeinfo>
@@ -218,6 +226,149 @@ bool is_plt_section(const char *secname)
     return !strcmp(secname, ".plt");
 }
 
+/* Describe the contents of a compressed section, either the gABI
+ * style with an ELF compression header and the SHF_COMPRESSED flag
+ * (gcc -gz=zlib) or the older GNU style .zdebug_* sections with
+ * their own small header (gcc -gz=zlib-gnu).  Returns false for
+ * compression we can't handle. */
+template<class Chdr> static bool
+describe_compressed_section(const unsigned char *base, bool is_gabi,
+			    file_section_t &fs)
+{
+    const unsigned char *p = base + fs.offset;
+    if (is_gabi)
+    {
+	if (fs.size < sizeof(Chdr))
+	    return false;
+	const Chdr *ch = (const Chdr *)p;
+	if (ch->ch_type != ELFCOMPRESS_ZLIB)
+	{
+	    dprintf("section %s uses unsupported compression type %u\n",
+		    fs.name.c_str(), (unsigned)ch->ch_type);
+	    return false;
+	}
+	fs.uncompressed_size = ch->ch_size;
+	fs.offset += sizeof(Chdr);
+	fs.size -= sizeof(Chdr);
+    }
+    else
+    {
+	/* "ZLIB" then the size as a 64-bit big-endian number */
+	if (fs.size < 12 || memcmp(p, "ZLIB", 4))
+	    return false;
+	fs.uncompressed_size = 0;
+	for (int i = 4 ; i < 12 ; i++)
+	    fs.uncompressed_size = (fs.uncompressed_size << 8) | p[i];
+	fs.offset += 12;
+	fs.size -= 12;
+	fs.name = "." + fs.name.substr(2);
+    }
+    fs.compressed = true;
+    return true;
+}
+
+template<class Ehdr, class Shdr, class Chdr> static bool
+read_elf_sections(const unsigned char *base, size_t size,
+		  vector<file_section_t> &sections)
+{
+    const Ehdr *eh = (const Ehdr *)base;
+    if (size < sizeof(Ehdr) ||
+	!eh->e_shoff ||
+	eh->e_shentsize != sizeof(Shdr) ||
+	eh->e_shoff + sizeof(Shdr) > size)
+	return false;
+    const Shdr *sh = (const Shdr *)(base + eh->e_shoff);
+
+    /* With very many sections, the real count and string
+     * table index are stored in the first section header */
+    unsigned long shnum = eh->e_shnum;
+    if (!shnum)
+	shnum = sh[0].sh_size;
+    unsigned long shstrndx = eh->e_shstrndx;
+    if (shstrndx == SHN_XINDEX)
+	shstrndx = sh[0].sh_link;
+    if (eh->e_shoff + shnum * sizeof(Shdr) > size ||
+	shstrndx >= shnum)
+	return false;
+
+    const Shdr *strsh = &sh[shstrndx];
+    if (strsh->sh_offset + strsh->sh_size > size)
+	return false;
+    const char *strtab = (const char *)base + strsh->sh_offset;
+    unsigned long strsize = strsh->sh_size;
+
+    for (unsigned long i = 1 ; i < shnum ; i++)
+    {
+	if (sh[i].sh_type == SHT_NULL || sh[i].sh_type == SHT_NOBITS)
+	    continue;   // no contents in the file
+	if (sh[i].sh_name >= strsize ||
+	    !memchr(strtab + sh[i].sh_name, '\0', strsize - sh[i].sh_name) ||
+	    sh[i].sh_offset + sh[i].sh_size > size)
+	    return false;
+	file_section_t fs;
+	fs.name = strtab + sh[i].sh_name;
+	fs.offset = sh[i].sh_offset;
+	fs.size = sh[i].sh_size;
+	fs.compressed = false;
+	fs.uncompressed_size = fs.size;
+	bool is_gabi = !!(sh[i].sh_flags & SHF_COMPRESSED);
+	if ((is_gabi || !strncmp(fs.name.c_str(), ".zdebug_", 8)) &&
+	    !describe_compressed_section<Chdr>(base, is_gabi, fs))
+	    continue;
+	sections.push_back(fs);
+    }
+    return true;
+}
+
+bool get_file_sections(const char *filename, vector<file_section_t> &sections)
+{
+    int fd = open(filename, O_RDONLY, 0);
+    if (fd < 0)
+	return false;
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || (size_t)sb.st_size < EI_NIDENT)
+    {
+	close(fd);
+	return false;
+    }
+    size_t size = sb.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+	return false;
+
+    const unsigned char *ident = (const unsigned char *)map;
+    vector<file_section_t> found;
+    bool r = false;
+    if (memcmp(ident, ELFMAG, SELFMAG) ||
+	ident[EI_DATA] != (__BYTE_ORDER == __LITTLE_ENDIAN ? ELFDATA2LSB : ELFDATA2MSB))
+	dprintf("%s: not a native ELF file\n", filename);
+    else if (ident[EI_CLASS] == ELFCLASS64)
+	r = read_elf_sections<Elf64_Ehdr, Elf64_Shdr, Elf64_Chdr>(ident, size, found);
+    else if (ident[EI_CLASS] == ELFCLASS32)
+	r = read_elf_sections<Elf32_Ehdr, Elf32_Shdr, Elf32_Chdr>(ident, size, found);
+    munmap(map, size);
+
+    if (!r)
+	return false;
+    sections.swap(found);
+    return true;
+}
+
+unsigned long resident_bytes(const void *addr, unsigned long len)
+{
+    unsigned long pagesize = getpagesize();
+    unsigned long start = (unsigned long)addr & ~(pagesize-1);
+    unsigned long npages = ((unsigned long)addr + len - start + pagesize-1) / pagesize;
+    vector<unsigned char> vec(npages);
+    if (!npages || mincore((void *)start, npages * pagesize, vec.data()) < 0)
+	return 0;
+    unsigned long n = 0;
+    for (unsigned char v : vec)
+	n += (v & 1);
+    return n * pagesize;
+}
+
 np::spiegel::addr_t follow_plt(np::spiegel::addr_t addr)
 {
     Dl_info info;
@@ -462,9 +613,229 @@ int clock_gettime(int clk_id, struct timespec *res)
     return ::clock_gettime(clk_id, res);
 }
 
-bool symbol_filename(const char *filename __attribute__((unused)),
-		     std::string &symfile __attribute__((unused)))
+/* What identifies an object's separate debug file: the GNU
+ * build-id note, and the filename and CRC in .gnu_debuglink */
+struct debug_ident_t
+{
+    string build_id;	/* raw bytes */
+    string debuglink;
+    uint32_t crc;
+
+    debug_ident_t() : crc(0) {}
+};
+
+static bool
+read_file_range(const char *filename, unsigned long offset,
+		unsigned long size, string &buf)
+{
+    int fd = open(filename, O_RDONLY, 0);
+    if (fd < 0)
+	return false;
+    buf.resize(size);
+    ssize_t n = (size ? pread(fd, &buf[0], size, offset) : 0);
+    close(fd);
+    return (n == (ssize_t)size);
+}
+
+/* Fill @id from the build-id note and .gnu_debuglink sections
+ * found in @secs, the sections of @filename. */
+static void
+get_debug_ident(const char *filename, const vector<file_section_t> &secs,
+		debug_ident_t &id)
+{
+    for (const file_section_t &fs : secs)
+    {
+	string buf;
+	if (fs.name == ".note.gnu.build-id")
+	{
+	    if (!read_file_range(filename, fs.offset, fs.size, buf))
+		continue;
+	    /* a sequence of 4-byte aligned notes; the Elf32
+	     * and Elf64 note headers are the same */
+	    size_t off = 0;
+	    while (off + sizeof(Elf64_Nhdr) <= buf.size())
+	    {
+		const Elf64_Nhdr *nh = (const Elf64_Nhdr *)(buf.data() + off);
+		size_t name = off + sizeof(Elf64_Nhdr);
+		size_t desc = name + ((nh->n_namesz + 3) & ~3);
+		off = desc + ((nh->n_descsz + 3) & ~3);
+		if (off > buf.size())
+		    break;
+		if (nh->n_type == NT_GNU_BUILD_ID &&
+		    nh->n_namesz == 4 &&
+		    !memcmp(buf.data() + name, "GNU", 4))
+		{
+		    id.build_id = buf.substr(desc, nh->n_descsz);
+		    break;
+		}
+	    }
+	}
+	else if (fs.name == ".gnu_debuglink")
+	{
+	    /* a filename, padded to 4 bytes, then a CRC32 */
+	    if (!read_file_range(filename, fs.offset, fs.size, buf))
+		continue;
+	    size_t len = strnlen(buf.data(), buf.size());
+	    size_t crcoff = (len + 4) & ~3;
+	    if (!len || crcoff + 4 > buf.size())
+		continue;
+	    id.debuglink = buf.substr(0, len);
+	    memcpy(&id.crc, buf.data() + crcoff, 4);
+	}
+    }
+}
+
+#if HAVE_ZLIB
+static bool
+get_file_crc(const char *filename, uint32_t &crc)
+{
+    int fd = open(filename, O_RDONLY, 0);
+    if (fd < 0)
+	return false;
+    struct stat sb;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &sb) == 0 && sb.st_size > 0)
+	map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+	return false;
+    crc = crc32(0L, (const Bytef *)map, sb.st_size);
+    munmap(map, sb.st_size);
+    return true;
+}
+#endif
+
+/* Check that @candidate is the separate debug file for an object
+ * identified by @id.  A build-id must match when both have one;
+ * otherwise the .gnu_debuglink CRC is checked if we can. */
+static bool
+is_debug_file_for(const string &candidate, const debug_ident_t &id,
+		  bool check_crc)
+{
+    if (access(candidate.c_str(), R_OK) < 0)
+	return false;
+    dprintf("trying separate debug file %s\n", candidate.c_str());
+    debug_ident_t cid;
+    vector<file_section_t> csecs;
+    if (get_file_sections(candidate.c_str(), csecs))
+	get_debug_ident(candidate.c_str(), csecs, cid);
+    if (id.build_id.length() && cid.build_id.length())
+	return (id.build_id == cid.build_id);
+    if (!check_crc)
+	return false;
+#if HAVE_ZLIB
+    uint32_t crc;
+    return (get_file_crc(candidate.c_str(), crc) && crc == id.crc);
+#else
+    return true;
+#endif
+}
+
+bool get_build_id(const char *filename,
+		  const vector<file_section_t> &sections,
+		  std::string &build_id)
+{
+    debug_ident_t id;
+    for (const file_section_t &fs : sections)
+    {
+	if (fs.name == ".note.gnu.build-id")
+	{
+	    vector<file_section_t> note(1, fs);
+	    get_debug_ident(filename, note, id);
+	    break;
+	}
+    }
+    build_id = id.build_id;
+    return build_id.length() > 0;
+}
+
+/* Directories where separate debug files are installed, from
+ * $NOVAPROVA_DEBUG_DIR (a colon-separated list) then the
+ * system default. */
+static vector<string>
+get_debug_dirs()
+{
+    vector<string> dirs;
+    const char *env = getenv("NOVAPROVA_DEBUG_DIR");
+    if (env)
+    {
+	tok_t tok(env, ":");
+	while (const char *d = tok.next())
+	    dirs.push_back(d);
+    }
+    dirs.push_back("/usr/lib/debug");
+    return dirs;
+}
+
+/*
+ * Find the separate debug file for an object whose debug info was
+ * stripped, looking in the same places GDB does: first by GNU build-id
+ * in the .build-id directory of each debug directory, then by the
+ * .gnu_debuglink filename next to the object, in a .debug/ directory
+ * next to the object, and under each debug directory.
+ */
+bool symbol_filename(const char *filename,
+		     const vector<file_section_t> &sections,
+		     const std::string &build_id,
+		     std::string &symfile)
 {
+    debug_ident_t id;
+    id.build_id = build_id;
+    for (const file_section_t &fs : sections)
+    {
+	if (fs.name == ".gnu_debuglink")
+	{
+	    vector<file_section_t> link(1, fs);
+	    get_debug_ident(filename, link, id);
+	    break;
+	}
+    }
+    if (!id.build_id.length() && !id.debuglink.length())
+	return false;
+    vector<string> dirs = get_debug_dirs();
+
+    if (id.build_id.length() > 1)
+    {
+	string hex;
+	for (unsigned char c : id.build_id)
+	{
+	    char buf[3];
+	    snprintf(buf, sizeof(buf), "%02x", c);
+	    hex += buf;
+	}
+	for (const string &d : dirs)
+	{
+	    string candidate = d + "/.build-id/" + hex.substr(0, 2) +
+			       "/" + hex.substr(2) + ".debug";
+	    if (is_debug_file_for(candidate, id, /*check_crc*/false))
+	    {
+		symfile = candidate;
+		return true;
+	    }
+	}
+    }
+
+    if (id.debuglink.length())
+    {
+	string dir = filename_t(filename).make_absolute();
+	dir.resize(dir.rfind('/') + 1);
+	vector<string> candidates;
+	candidates.push_back(dir + id.debuglink);
+	candidates.push_back(dir + ".debug/" + id.debuglink);
+	for (const string &d : dirs)
+	    candidates.push_back(d + dir + id.debuglink);
+	for (const string &candidate : candidates)
+	{
+	    if (candidate != filename &&
+		is_debug_file_for(candidate, id, /*check_crc*/true))
+	    {
+		symfile = candidate;
+		return true;
+	    }
+	}
+    }
+
+    dprintf("no separate debug file found for %s\n", filename);
     return false;
 }
 
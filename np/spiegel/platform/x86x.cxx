@@ -116,43 +116,93 @@ call_instruction_length_for_ra(unsigned long ra)
 #undef ANY
 }
 
-vector<np::spiegel::addr_t> get_stacktrace()
+static unwinder_t unwinder;
+
+void set_unwinder(unwinder_t fn)
+{
+    unwinder = fn;
+}
+
+/* Step from @frame to its caller by following the saved frame
+ * pointer.  This only works if a frame pointer is used, i.e. it
+ * breaks with -fomit-frame-pointer, so it's only a fallback for
+ * frames the unwinder knows nothing about.
+ *
+ * TODO: terminating the unwind loop is tricky to do properly,
+ *       we need to estimate the stack boundaries.  Instead
+ *       we approximate */
+static bool
+frame_pointer_step(frame_t &frame)
+{
+    /* the frame pointer of @frame's function points at
+     * the saved frame pointer, just below the CFA */
+    unsigned long bp = frame.sp - 2*sizeof(unsigned long);
+    unsigned long nextbp = frame.bp;
+    if (!nextbp)
+	return false;
+    if (nextbp < bp)
+	return false;	// moving in the wrong direction
+    if ((nextbp - bp) > 16384)
+	return false;	// moving a heuristic "too far"
+    frame.pc = ((unsigned long *)nextbp)[1];
+    frame.sp = nextbp + 2*sizeof(unsigned long);
+    frame.bp = ((unsigned long *)nextbp)[0];
+    return true;
+}
+
+unsigned int get_stacktrace(np::spiegel::addr_t *stack, unsigned int max)
 {
-    /* This only works if a frame pointer is used, i.e. it breaks
-     * with -fomit-frame-pointer.
-     *
-     * TODO: use DWARF2 unwind info and handle -fomit-frame-pointer
-     *
-     * TODO: terminating the unwind loop is tricky to do properly,
-     *       we need to estimate the stack boundaries.  Instead
-     *       we approximate
-     *
-     * TODO: should return a vector of {ip=%eip,fp=%ebp,sp=%esp}
-     */
     unsigned long bp;
-    vector<np::spiegel::addr_t> stack;
+    unsigned int n = 0;
 
 #if _NP_ADDRSIZE == 4
     __asm__ volatile("movl %%ebp, %0" : "=r"(bp));
 #else
     __asm__ volatile("movq %%rbp, %0" : "=r"(bp));
 #endif
-    for (;;)
+    /* We have a frame pointer, so our caller's frame is easy */
+    frame_t frame;
+    frame.pc = ((unsigned long *)bp)[1];
+    frame.sp = bp + 2*sizeof(unsigned long);
+    frame.bp = ((unsigned long *)bp)[0];
+    while (n < max)
     {
-        unsigned long ra = ((unsigned long *)bp)[1];
-        if (ra > 4096)
-            ra -= call_instruction_length_for_ra(ra);
-	stack.push_back(ra);
-	unsigned long nextbp = ((unsigned long *)bp)[0];
-	if (!nextbp)
-	    break;
-	if (nextbp < bp)
+	/* Report, and unwind from, the CALL instruction
+	 * rather than the return address after it */
+        if (frame.pc > 4096)
+            frame.pc -= call_instruction_length_for_ra(frame.pc);
+	stack[n++] = frame.pc;
+
+	frame_t caller = frame;
+	if (!unwinder || !unwinder(caller))
+	{
+	    caller = frame;
+	    if (!frame_pointer_step(caller))
+		break;
+	}
+	if (!caller.pc)
+	    break;	// outermost frame
+	if (caller.sp <= frame.sp)
 	    break;	// moving in the wrong direction
-	if ((nextbp - bp) > 16384)
-	    break;	// moving a heuristic "too far"
-	bp = nextbp;
+	frame = caller;
     };
-    return stack;
+    return n;
+}
+
+vector<np::spiegel::addr_t> get_stacktrace()
+{
+    vector<np::spiegel::addr_t> stack(256);
+    for (;;)
+    {
+	unsigned int n = get_stacktrace(stack.data(), stack.size());
+	if (n < stack.size())
+	{
+	    stack.resize(n);
+	    return stack;
+	}
+	// might have been truncated, try again bigger
+	stack.resize(2*stack.size());
+    }
 }
 
 // Close namespaces
@@ -21,6 +21,7 @@
 #include "np/spiegel/platform/common.hxx"
 #include "np/util/log.hxx"
 #include <algorithm>
+#include <new>
 
 namespace np {
 namespace spiegel {
@@ -342,34 +343,47 @@ type_t::to_string() const
 }
 
 state_t::state_t()
+ :  location_hits_(0),
+    location_misses_(0)
 {
     state_ = new np::spiegel::dwarf::state_t();
 }
 
 state_t::~state_t()
 {
+    dprintf("location cache: %lu hits, %lu misses\n",
+	    location_hits_, location_misses_);
     delete state_;
 }
 
 bool
 state_t::add_self()
 {
+    clear_location_cache();
     return state_->add_self();
 }
 
 bool
 state_t::add_executable(const char *filename)
 {
+    clear_location_cache();
     return state_->add_executable(filename);
 }
 
+bool
+state_t::write_index_files() const
+{
+    return state_->write_index_files();
+}
+
 compile_unit_t *
 state_t::cu_from_lower(np::spiegel::dwarf::compile_unit_t *lcu)
 {
     compile_unit_t *cu = compile_unit_t::to_upper(lcu);
     if (!cu)
     {
-        cu = new compile_unit_t(lcu->make_root_reference(), factory_);
+        cu = new(factory_.arena_.alloc(sizeof(compile_unit_t)))
+		compile_unit_t(lcu->make_root_reference(), factory_);
         lcu->set_upper(cu);
     }
     return cu;
@@ -473,6 +487,43 @@ member_t::get_compile_unit() const
     return static_cast<compile_unit_t*>(res._cu->get_upper());
 }
 
+/* Decode the function's DIE and its children once, and
+ * append a row describing it to the table. */
+uint32_t
+_function_table_t::add(np::spiegel::dwarf::walker_t &w)
+{
+    const np::spiegel::dwarf::entry_t *e = w.get_entry();
+    uint32_t idx = low_pc_.size();
+    uint8_t flags = 0;
+
+    low_pc_.push_back(e->get_uint64_attribute(DW_AT_low_pc));
+    live_pc_.push_back(w.live_address(e->get_address_attribute(DW_AT_low_pc)));
+    return_type_.push_back(e->get_reference_attribute(DW_AT_type));
+    if (e->get_uint64_attribute(DW_AT_declaration))
+	flags |= F_DECLARATION;
+    first_param_.push_back(param_type_.size());
+
+    uint32_t nparams = 0;
+    for (e = w.move_down() ; e ; e = w.move_next())
+    {
+	if (e->get_tag() == DW_TAG_formal_parameter)
+	{
+	    param_type_.push_back(e->get_reference_attribute(DW_AT_type));
+	    param_name_.push_back(e->get_string_attribute(DW_AT_name));
+	    nparams++;
+	}
+	else if (e->get_tag() == DW_TAG_unspecified_parameters)
+	{
+	    flags |= F_UNSPECIFIED_PARAMS;
+	    break;
+	}
+    }
+    nparams_.push_back(nparams);
+    flags_.push_back(flags);
+
+    return idx;
+}
+
 bool
 function_t::populate()
 {
@@ -482,9 +533,7 @@ function_t::populate()
     if (!e)
 	return false;
 
-    low_pc_ = e->get_uint64_attribute(DW_AT_low_pc);
-    is_declaration_ = e->get_uint64_attribute(DW_AT_declaration);
-
+    index_ = factory_.functions_.add(w);
     return true;
 }
 
@@ -498,46 +547,34 @@ function_t::get_full_name() const
 type_t *
 function_t::get_return_type() const
 {
-    np::spiegel::dwarf::walker_t w(ref_);
-    const np::spiegel::dwarf::entry_t *e = w.move_next();
-    return factory_.make_type(e->get_reference_attribute(DW_AT_type));
+    return factory_.make_type(factory_.functions_.return_type_[index_]);
 }
 
 vector<type_t*>
 function_t::get_parameter_types() const
 {
+    const _function_table_t &ft = factory_.functions_;
     vector<type_t *> res;
 
-    np::spiegel::dwarf::walker_t w(ref_);
-    const np::spiegel::dwarf::entry_t *e = w.move_next();
-    for (e = w.move_down() ; e ; e = w.move_next())
-    {
-	if (e->get_tag() == DW_TAG_formal_parameter)
-	    res.push_back(factory_.make_type(e->get_reference_attribute(DW_AT_type)));
-	else if (e->get_tag() == DW_TAG_unspecified_parameters)
-	    break;
-    }
+    uint32_t first = ft.first_param_[index_];
+    for (uint32_t i = 0 ; i < ft.nparams_[index_] ; i++)
+	res.push_back(factory_.make_type(ft.param_type_[first+i]));
     return res;
 }
 
 vector<const char *>
 function_t::get_parameter_names() const
 {
+    const _function_table_t &ft = factory_.functions_;
     vector<const char *> res;
 
-    np::spiegel::dwarf::walker_t w(ref_);
-    const np::spiegel::dwarf::entry_t *e = w.move_next();
-    for (e = w.move_down() ; e ; e = w.move_next())
+    uint32_t first = ft.first_param_[index_];
+    for (uint32_t i = 0 ; i < ft.nparams_[index_] ; i++)
     {
-	if (e->get_tag() == DW_TAG_formal_parameter)
-	{
-	    const char *name = e->get_string_attribute(DW_AT_name);
-	    if (!name || !*name)
-		name = "<unknown>";
-	    res.push_back(name);
-	}
-	else if (e->get_tag() == DW_TAG_unspecified_parameters)
-	    break;
+	const char *name = ft.param_name_[first+i];
+	if (!name || !*name)
+	    name = "<unknown>";
+	res.push_back(name);
     }
     return res;
 }
@@ -545,43 +582,32 @@ function_t::get_parameter_names() const
 bool
 function_t::has_unspecified_parameters() const
 {
-    np::spiegel::dwarf::walker_t w(ref_);
-    const np::spiegel::dwarf::entry_t *e = w.move_next();
-    for (e = w.move_down() ; e ; e = w.move_next())
-    {
-	if (e->get_tag() == DW_TAG_unspecified_parameters)
-	    return true;
-    }
-    return false;
+    return !!(factory_.functions_.flags_[index_] & _function_table_t::F_UNSPECIFIED_PARAMS);
 }
 
 string
 function_t::to_string() const
 {
-    np::spiegel::dwarf::walker_t w(ref_);
-    const np::spiegel::dwarf::entry_t *e = w.move_next();
-    type_t return_type(e->get_reference_attribute(DW_AT_type), factory_);
+    const _function_table_t &ft = factory_.functions_;
+    type_t return_type(ft.return_type_[index_], factory_);
     string inner = name_;
     inner += "(";
-    unsigned int nparam = 0;
-    for (e = w.move_down() ; e ; e = w.move_next())
+    uint32_t first = ft.first_param_[index_];
+    uint32_t nparam = ft.nparams_[index_];
+    for (uint32_t i = 0 ; i < nparam ; i++)
     {
-	if (e->get_tag() == DW_TAG_formal_parameter)
-	{
-	    if (nparam++)
-		inner += ", ";
-	    const char *param = e->get_string_attribute(DW_AT_name);
-	    if (!param)
-		param = "";
-	    inner += type_t(e->get_reference_attribute(DW_AT_type), factory_).to_string(param);
-	}
-	else if (e->get_tag() == DW_TAG_unspecified_parameters)
-	{
-	    if (nparam++)
-		inner += ", ";
-	    inner += "...";
-	    break;
-	}
+	if (i)
+	    inner += ", ";
+	const char *param = ft.param_name_[first+i];
+	if (!param)
+	    param = "";
+	inner += type_t(ft.param_type_[first+i], factory_).to_string(param);
+    }
+    if (has_unspecified_parameters())
+    {
+	if (nparam)
+	    inner += ", ";
+	inner += "...";
     }
     inner += ")";
     return return_type.to_string(inner);
@@ -596,7 +622,7 @@ function_t::to_string() const
 addr_t
 function_t::get_address() const
 {
-    return low_pc_;
+    return factory_.functions_.low_pc_[index_];
 }
 
 // Return the live address of the function, or 0 if the function is not
@@ -606,15 +632,13 @@ function_t::get_address() const
 addr_t
 function_t::get_live_address() const
 {
-    np::spiegel::dwarf::walker_t w(ref_);
-    const np::spiegel::dwarf::entry_t *e = w.move_next();
-    return w.live_address(e->get_address_attribute(DW_AT_low_pc));
+    return factory_.functions_.live_pc_[index_];
 }
 
 bool
 function_t::is_declaration() const
 {
-    return is_declaration_;
+    return !!(factory_.functions_.flags_[index_] & _function_table_t::F_DECLARATION);
 }
 
 
@@ -647,8 +671,49 @@ function_t::invoke(vector<value_t> args __attribute__((unused))) const
 }
 #endif
 
+void
+state_t::clear_location_cache()
+{
+    location_cache_.clear();
+}
+
+state_t::cached_location_t *
+state_t::get_cached_location(addr_t addr)
+{
+    if (!location_cache_.size())
+	location_cache_.resize(LOCATION_CACHE_SIZE);
+
+    // Fibonacci hashing, using the top bits of the product
+    uint64_t h = ((uint64_t)addr * 0x9e3779b97f4a7c15ULL) >> (64 - LOCATION_CACHE_BITS);
+    cached_location_t *cl = &location_cache_[h];
+    if (cl->valid_ && cl->addr_ == addr)
+    {
+	location_hits_++;
+	return cl;
+    }
+
+    location_misses_++;
+    cl->addr_ = addr;
+    cl->valid_ = true;
+    cl->loc_ = location_t();
+    cl->found_ = lookup_address(addr, cl->loc_);
+    cl->have_frame_ = false;
+    cl->is_main_ = false;
+    cl->frame_.clear();
+    return cl;
+}
+
 bool
 state_t::describe_address(addr_t addr, class location_t &loc)
+{
+    cached_location_t *cl = get_cached_location(addr);
+    if (cl->found_)
+	loc = cl->loc_;
+    return cl->found_;
+}
+
+bool
+state_t::lookup_address(addr_t addr, class location_t &loc)
 {
     addr = state_->recorded_address(addr);
 
@@ -679,19 +744,65 @@ state_t::describe_address(addr_t addr, class location_t &loc)
 }
 
 
+static inline unsigned
+hash_reference(np::spiegel::dwarf::reference_t ref)
+{
+    uint64_t h = (uint64_t)(unsigned long)ref.resolver ^ ref.offset;
+    // mix the bits, from MurmurHash3's 64-bit finalizer
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (unsigned)h;
+}
+
 _cacheable_t *
 _factory_t::find(np::spiegel::dwarf::reference_t ref)
 {
-    std::map<np::spiegel::dwarf::reference_t, _cacheable_t*>::const_iterator i = cache_.find(ref);
-    if (i == cache_.end())
+    if (!nentries_)
 	return 0;
-    return i->second;
+    unsigned mask = buckets_.size()-1;
+    for (unsigned i = hash_reference(ref) & mask ; ; i = (i+1) & mask)
+    {
+	_cacheable_t *cc = buckets_[i];
+	if (!cc)
+	    return 0;
+	if (cc->ref() == ref)
+	    return cc;
+    }
+}
+
+void
+_factory_t::grow()
+{
+    vector<_cacheable_t*> old;
+    old.swap(buckets_);
+    buckets_.resize(old.size() ? 2*old.size() : 256, 0);
+    unsigned mask = buckets_.size()-1;
+    for (_cacheable_t *cc : old)
+    {
+	if (!cc)
+	    continue;
+	unsigned i = hash_reference(cc->ref()) & mask;
+	while (buckets_[i])
+	    i = (i+1) & mask;
+	buckets_[i] = cc;
+    }
 }
 
 _cacheable_t *
 _factory_t::add(_cacheable_t *cc)
 {
-    cache_[cc->ref()] = cc;
+    // keep the load factor at or below 1/2
+    if (2*(nentries_+1) > buckets_.size())
+	grow();
+    unsigned mask = buckets_.size()-1;
+    unsigned i = hash_reference(cc->ref()) & mask;
+    while (buckets_[i])
+	i = (i+1) & mask;
+    buckets_[i] = cc;
+    nentries_++;
     return cc;
 }
 
@@ -699,9 +810,27 @@ type_t *
 _factory_t::make_type(np::spiegel::dwarf::reference_t ref)
 {
     _cacheable_t *cc = find(ref);
-    if (!cc)
-	cc = add(new type_t(ref, *this));
-    return (type_t *)cc;
+    if (cc)
+	return (type_t *)cc;
+
+    /* A compile unit may declare a type whose definition is in
+     * a type unit, e.g. to hang member function definitions on,
+     * in which case the type is the one in the type unit */
+    if (ref.resolver)
+    {
+	np::spiegel::dwarf::walker_t w(ref);
+	const np::spiegel::dwarf::entry_t *e = w.move_next();
+	np::spiegel::dwarf::reference_t sigref;
+	if (e && e->get_attribute(DW_AT_declaration) &&
+	    !((sigref = e->get_reference_attribute(DW_AT_signature)) ==
+		np::spiegel::dwarf::reference_t::null))
+	{
+	    if ((cc = find(sigref)))
+		return (type_t *)cc;
+	    ref = sigref;
+	}
+    }
+    return (type_t *)add(new(arena_.alloc(sizeof(type_t))) type_t(ref, *this));
 }
 
 function_t *
@@ -710,10 +839,10 @@ _factory_t::make_function(np::spiegel::dwarf::walker_t &w)
     function_t *fn = (function_t *)find(w.get_reference());
     if (!fn)
     {
-        fn = new function_t(w, *this);
+        fn = new(arena_.alloc(sizeof(function_t))) function_t(w, *this);
         if (!fn->populate())
         {
-            delete fn;
+	    // the arena space is just abandoned
             return 0;
         }
         add(fn);
@@ -731,38 +860,83 @@ _factory_t::make_function(np::spiegel::dwarf::reference_t ref)
     return (e ? make_function(w) : 0);
 }
 
+static void
+append_source_location(string &s, const np::util::filename_t &filename,
+		       uint32_t line)
+{
+    s += " (";
+    s += filename;
+    if (line)
+    {
+	s += ":";
+	s += dec(line);
+    }
+    s += ")";
+}
+
 std::string
 state_t::describe_stacktrace()
 {
-    string s;
     vector<addr_t> stack = np::spiegel::platform::get_stacktrace();
+    return describe_stacktrace(stack.data(), stack.size());
+}
+
+/* Describe a stack trace captured earlier, possibly by another
+ * process with the same address space layout e.g. a forked child. */
+std::string
+state_t::describe_stacktrace(const addr_t *stack, unsigned int nstack)
+{
+    string s;
     bool first = true;
-    for (addr_t addr : stack)
+    for (unsigned int i = 0 ; i < nstack ; i++)
     {
+	addr_t addr = stack[i];
 	s += (first ? "at " : "by ");
 	s += HEX(addr);
 	s += ":";
-	location_t loc;
-	if (describe_address(addr, loc))
+	cached_location_t *cl = get_cached_location(addr);
+	if (cl->found_)
 	{
-	    if (loc.function_)
+	    if (!cl->have_frame_)
 	    {
-		s += " ";
-		s += loc.function_->get_full_name();
-	    }
+		const location_t &loc = cl->loc_;
+		np::util::filename_t filename = loc.filename_;
+		uint32_t line = loc.line_;
+
+		/* In optimised code there may be functions inlined
+		 * at this address, which get a synthetic frame each
+		 * at the same address, innermost first. */
+		vector<dwarf::state_t::inline_t> inlines;
+		state_->describe_inlines(state_->recorded_address(addr), inlines);
+		for (const dwarf::state_t::inline_t &in : inlines)
+		{
+		    function_t *fn = factory_.make_function(in.funcref);
+		    if (fn)
+		    {
+			cl->frame_ += " ";
+			cl->frame_ += fn->get_full_name();
+		    }
+		    append_source_location(cl->frame_, filename, line);
+		    cl->frame_ += "\nby ";
+		    cl->frame_ += HEX(addr);
+		    cl->frame_ += ":";
+		    filename = in.call_filename;
+		    line = in.call_line;
+		}
 
-	    if (loc.compile_unit_)
-	    {
-		s += " (";
-		s += loc.filename_;
-		if (loc.line_)
+		if (loc.function_)
 		{
-		    s += ":";
-		    s += dec(loc.line_);
+		    cl->frame_ += " ";
+		    cl->frame_ += loc.function_->get_full_name();
 		}
-		s += ")";
+
+		if (loc.compile_unit_)
+		    append_source_location(cl->frame_, filename, line);
+		cl->is_main_ = (loc.function_ && loc.function_->get_name() == "main");
+		cl->have_frame_ = true;
 	    }
-	    if (loc.function_ && loc.function_->get_name() == "main")
+	    s += cl->frame_;
+	    if (cl->is_main_)
             {
                 s += "\n";
                 break;
@@ -21,6 +21,7 @@
 #include "np/spiegel/dwarf/compile_unit.hxx"
 #include "np/spiegel/intercept.hxx"
 #include "np/util/filename.hxx"
+#include "np/util/arena.hxx"
 
 #define SPIEGEL_DYNAMIC 1
 
@@ -323,13 +324,44 @@ private:
 
     bool populate();
 
-    uint64_t low_pc_;	    // TODO: should be an addr_t
-    bool is_declaration_;
+    uint32_t index_;	    // row in the factory's _function_table_t
 
     friend class compile_unit_t;
     friend class _factory_t;
 };
 
+// Metadata for every function_t, stored as a set of parallel
+// arrays indexed by function_t::index_.  Each row is filled in
+// by a single walk over the function's DIE and its children
+// when the function_t is created, so the function_t getters
+// never need to go back to the DWARF info.
+class _function_table_t
+{
+public:
+    enum
+    {
+	F_DECLARATION =		(1<<0),
+	F_UNSPECIFIED_PARAMS =	(1<<1),
+    };
+
+    uint32_t add(np::spiegel::dwarf::walker_t &w);
+
+private:
+    // one entry per function
+    std::vector<uint64_t> low_pc_;	    // TODO: should be an addr_t
+    std::vector<addr_t> live_pc_;
+    std::vector<np::spiegel::dwarf::reference_t> return_type_;
+    std::vector<uint8_t> flags_;
+    std::vector<uint32_t> first_param_;
+    std::vector<uint32_t> nparams_;
+    // one entry per formal parameter, each function's
+    // parameters being contiguous and in order
+    std::vector<np::spiegel::dwarf::reference_t> param_type_;
+    std::vector<const char *> param_name_;
+
+    friend class function_t;
+};
+
 class location_t
 {
 public:
@@ -354,15 +386,25 @@ public:
 //     field_t *make_field(np::spiegel::dwarf::reference_t);
 
 private:
-    _factory_t() {}
+    _factory_t() : nentries_(0) {}
     ~_factory_t() {}
 
     _cacheable_t *find(np::spiegel::dwarf::reference_t ref);
     _cacheable_t *add(_cacheable_t *cc);
-
-    std::map<np::spiegel::dwarf::reference_t, _cacheable_t*> cache_;
+    void grow();
+
+    // Open addressing hash table with linear probing, keyed on
+    // the (resolver, offset) pair of each object's reference.
+    // The size is always a power of 2.
+    std::vector<_cacheable_t*> buckets_;
+    unsigned nentries_;
+    // all the objects in the cache live here, and are
+    // released when the factory is destroyed
+    np::util::arena_t arena_;
+    _function_table_t functions_;
 
     friend class state_t;
+    friend class function_t;
 };
 
 class state_t
@@ -373,10 +415,19 @@ public:
 
     bool add_self();
     bool add_executable(const char *filename);
+    // Write a side file next to each link object added, which
+    // later runs use to avoid indexing its functions at startup
+    bool write_index_files() const;
 
     std::vector<compile_unit_t *> get_compile_units();
     bool describe_address(addr_t, class location_t &);
     std::string describe_stacktrace();
+    std::string describe_stacktrace(const addr_t *stack, unsigned int nstack);
+    void get_location_cache_stats(unsigned long &hits, unsigned long &misses) const
+    {
+	hits = location_hits_;
+	misses = location_misses_;
+    }
 
     // for testing only
     void dump_structs();
@@ -386,10 +437,36 @@ public:
     void dump_abbrevs();
 
 private:
+    // A memo of describe_address() results keyed on the runtime
+    // address, so that the same return addresses seen in trace
+    // after trace are only symbolised once.  It's bounded and
+    // direct mapped: an address simply replaces whatever else
+    // was cached in its slot.
+    struct cached_location_t
+    {
+	addr_t addr_;
+	bool valid_;
+	bool found_;
+	location_t loc_;
+	// the frame as described by describe_stacktrace(),
+	// after the address, built on first use
+	bool have_frame_;
+	bool is_main_;
+	std::string frame_;
+    };
+    enum { LOCATION_CACHE_BITS = 12,
+	   LOCATION_CACHE_SIZE = (1<<LOCATION_CACHE_BITS) };
+
     compile_unit_t *cu_from_lower(np::spiegel::dwarf::compile_unit_t *lcu);
+    bool lookup_address(addr_t, class location_t &);
+    cached_location_t *get_cached_location(addr_t);
+    void clear_location_cache();
 
      np::spiegel::dwarf::state_t *state_;
      _factory_t factory_;
+     std::vector<cached_location_t> location_cache_;
+     unsigned long location_hits_;
+     unsigned long location_misses_;
 };
 
 
@@ -228,28 +228,17 @@ np::spiegel::function_t *
 testmanager_t::find_mock_target(string name)
 {
     dprintf("Finding mock target %s", name.c_str());
-    vector<np::spiegel::compile_unit_t *> units = spiegel_->get_compile_units();
-    vector<np::spiegel::compile_unit_t *>::iterator i;
-    for (i = units.begin() ; i != units.end() ; ++i)
+    unordered_map<string, np::spiegel::function_t*>::const_iterator i =
+	function_index_.find(name);
+    if (i == function_index_.end())
     {
-	vector<np::spiegel::function_t *> fns = (*i)->get_functions();
-	vector<np::spiegel::function_t *>::iterator j;
-	for (j = fns.begin() ; j != fns.end() ; ++j)
-	{
-            if ((*j)->get_name() != name)
-                continue;
-            if ((*j)->is_declaration())
-                continue;
-            if (!(*j)->get_address())
-                continue;
-            dprintf("Found function %s in compile unit %s link object %s",
-                    name.c_str(), (*i)->get_filename().c_str(),
-                    (*i)->get_executable());
-            return *j;
-	}
+	dprintf("Failed to find mock target for %s", name.c_str());
+	return 0;
     }
-    dprintf("Failed to find mock target for %s", name.c_str());
-    return 0;
+    const np::spiegel::compile_unit_t *cu = i->second->get_compile_unit();
+    dprintf("Found function %s in compile unit %s link object %s",
+	    name.c_str(), cu->get_filename().c_str(), cu->get_executable());
+    return i->second;
 }
 
 static const struct __np_param_dec *
@@ -277,6 +266,10 @@ testmanager_t::discover_functions()
     vector<np::spiegel::compile_unit_t *> units = spiegel_->get_compile_units();
     vector<np::spiegel::compile_unit_t *>::iterator i;
     unsigned int ntests = 0;
+    // mock functions and their target names, which are looked
+    // up once every function has been seen
+    vector<pair<np::spiegel::function_t*, string> > mocks;
+    function_index_.clear();
     for (i = units.begin() ; i != units.end() ; ++i)
     {
 	dprintf("scanning compile unit %s\n", (*i)->get_absolute_path().c_str());
@@ -291,6 +284,10 @@ testmanager_t::discover_functions()
 	    // We want functions which are defined in this compile unit
 	    if (!fn->get_address())
 		continue;
+	    // Index functions by name for find_mock_target().  The
+	    // first definition in compile unit order wins.
+	    if (!fn->is_declaration())
+		function_index_.insert(make_pair(fn->get_name(), fn));
 
 	    type = classify_function(fn->get_name().c_str(),
 				     submatch, sizeof(submatch));
@@ -329,24 +326,7 @@ testmanager_t::discover_functions()
 		// Mock functions need a target name
 		if (!submatch[0])
 		    continue;
-		{
-                    if (warn_on_automock(submatch))
-                        wprintf("Mock target function %s is a function in "
-                                "libc which is commonly difficult to mock "
-                                "using NovaProva's automatic mocks.  Please "
-                                "read the section \"Automatic Mocks and The "
-                                "C Library\" in the manual for details.", submatch);
-		    np::spiegel::function_t *target = find_mock_target(submatch);
-		    if (!target)
-                    {
-                        wprintf("Unable to find mock target function %s for "
-                                "automatic mock function %s.  No mock will "
-                                "be installed.",
-                                submatch, fn->get_name().c_str());
-			continue;
-                    }
-		    root_->make_path(test_name(fn, 0))->add_mock(target, fn);
-		}
+		mocks.push_back(make_pair(fn, string(submatch)));
 		break;
 	    case FT_PARAM:
 		// Parameters need a name
@@ -360,6 +340,29 @@ testmanager_t::discover_functions()
 	}
     }
 
+    vector<pair<np::spiegel::function_t*, string> >::iterator m;
+    for (m = mocks.begin() ; m != mocks.end() ; ++m)
+    {
+	np::spiegel::function_t *fn = m->first;
+	const char *submatch = m->second.c_str();
+	if (warn_on_automock(submatch))
+	    wprintf("Mock target function %s is a function in "
+		    "libc which is commonly difficult to mock "
+		    "using NovaProva's automatic mocks.  Please "
+		    "read the section \"Automatic Mocks and The "
+		    "C Library\" in the manual for details.", submatch);
+	np::spiegel::function_t *target = find_mock_target(submatch);
+	if (!target)
+	{
+	    wprintf("Unable to find mock target function %s for "
+		    "automatic mock function %s.  No mock will "
+		    "be installed.",
+		    submatch, fn->get_name().c_str());
+	    continue;
+	}
+	root_->make_path(test_name(fn, 0))->add_mock(target, fn);
+    }
+
     if (!ntests)
 	wprintf("no tests discovered\n");
     // Calculate the effective root_ and common_
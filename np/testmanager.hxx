@@ -21,6 +21,7 @@
 #include "np/testnode.hxx"
 #include <string>
 #include <vector>
+#include <unordered_map>
 
 namespace np { namespace spiegel { namespace dwarf { class state_t; } } }
 
@@ -61,6 +62,8 @@ private:
     spiegel::state_t *spiegel_;
     testnode_t *root_;
     testnode_t *common_;	// nodes from filesystem root down to root_
+    // defined functions by name, built by discover_functions()
+    std::unordered_map<std::string, spiegel::function_t*> function_index_;
 };
 
 // close the namespaces
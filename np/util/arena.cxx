@@ -0,0 +1,76 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "np/util/arena.hxx"
+
+namespace np {
+namespace util {
+using namespace std;
+
+arena_t::~arena_t()
+{
+    while (blocks_)
+    {
+	block_t *b = blocks_;
+	blocks_ = b->next;
+	free(b);
+    }
+}
+
+/* Allocate a new block with room for @sz bytes after the
+ * header and link it into the list.  Returns a pointer to
+ * the first usable byte. */
+char *
+arena_t::new_block(size_t sz)
+{
+    size_t hdr = round_up(sizeof(block_t));
+    block_t *b = (block_t *)xmalloc(hdr + sz);
+    b->next = blocks_;
+    blocks_ = b;
+    nblocks_++;
+    return (char *)b + hdr;
+}
+
+void *
+arena_t::alloc(size_t sz)
+{
+    sz = round_up(sz ? sz : 1);
+    nallocs_++;
+    nbytes_ += sz;
+
+    if (sz <= (size_t)(end_ - ptr_))
+    {
+	void *p = ptr_;
+	ptr_ += sz;
+	return p;
+    }
+
+    if (sz > blocksize_ / 4)
+    {
+	/* A large allocation gets a block all to itself, so
+	 * that the space left in the current block isn't wasted */
+	return new_block(sz);
+    }
+
+    /* Start a new current block; whatever is left at
+     * the end of the old one is wasted. */
+    char *p = new_block(blocksize_);
+    ptr_ = p + sz;
+    end_ = p + blocksize_;
+    return p;
+}
+
+// close the namespaces
+}; };
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __np_util_arena_hxx__
+#define __np_util_arena_hxx__ 1
+
+#include "np/util/common.hxx"
+
+namespace np { namespace util {
+
+/*
+ * A simple bump allocator.  Memory is carved sequentially out of
+ * large zeroed blocks and is never freed individually; all of it
+ * is released in one go when the arena is destroyed.  Destructors
+ * of objects placement-new'd into the arena are never run, so
+ * only objects with trivial (or empty) destructors belong here.
+ */
+class arena_t
+{
+public:
+    arena_t(size_t blocksize = 64*1024)
+     :  blocks_(0),
+	ptr_(0),
+	end_(0),
+	blocksize_(blocksize),
+	nblocks_(0),
+	nallocs_(0),
+	nbytes_(0)
+    {}
+    ~arena_t();
+
+    // returns zeroed memory suitably aligned for any type
+    void *alloc(size_t sz);
+
+    unsigned get_nblocks() const { return nblocks_; }
+    unsigned long get_nallocs() const { return nallocs_; }
+    // bytes handed out by alloc(), including alignment padding
+    size_t get_nbytes() const { return nbytes_; }
+
+private:
+    // not copyable
+    arena_t(const arena_t &);
+    arena_t &operator=(const arena_t &);
+
+    struct block_t
+    {
+	block_t *next;
+    };
+    enum { ALIGN = 16 };
+    static size_t round_up(size_t sz) { return (sz + ALIGN-1) & ~(size_t)(ALIGN-1); }
+    char *new_block(size_t sz);
+
+    block_t *blocks_;
+    char *ptr_;		    // next free byte in current block
+    char *end_;		    // end of current block
+    size_t blocksize_;
+    unsigned nblocks_;
+    unsigned long nallocs_;
+    size_t nbytes_;
+};
+
+// close the namespaces
+}; };
+
+#endif /* __np_util_arena_hxx__ */
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __np_util_range_index_hxx__
+#define __np_util_range_index_hxx__ 1
+
+#include <vector>
+#include <algorithm>
+#include <assert.h>
+
+namespace np { namespace util {
+
+/*
+ * A build-once, query-many index from half-open ranges [lo,hi) of
+ * keys to values.  Ranges are collected with insert(), then build()
+ * sorts them into flat parallel arrays, and find() does a binary
+ * search over the array of range starts.  Compared to rangetree
+ * there's no per-range allocation and lookups touch a few adjacent
+ * cache lines instead of chasing tree pointers.
+ *
+ * A range with lo == hi matches exactly that one key.  Inserting the
+ * same range twice replaces the value, as with rangetree.  Ranges may
+ * overlap or nest; find() returns the matching range which starts
+ * last, or of those starting at the same key the shortest, so with
+ * properly nested ranges it returns the innermost.
+ *
+ * Inserting after build() is allowed, but build() must be called
+ * again before the next find().  That build() sorts only the new
+ * ranges and merges them in, so adding a few ranges to a large index
+ * is cheap.
+ *
+ * A built index is just the four sorted arrays, so it can be saved,
+ * and attach() makes an index which searches saved arrays in place,
+ * e.g. mapped read-only from a file, without copying them.
+ */
+template <typename K, typename V> class range_index
+{
+public:
+    range_index()
+     :  plos_(0), phis_(0), pmaxhis_(0), pvalues_(0), n_(0),
+	nbuilt_(0), built_(true), attached_(false)
+    {}
+
+    unsigned size() const { return (attached_ ? n_ : los_.size()); }
+    void clear()
+    {
+	los_.clear();
+	his_.clear();
+	maxhis_.clear();
+	values_.clear();
+	plos_ = phis_ = pmaxhis_ = 0;
+	pvalues_ = 0;
+	n_ = 0;
+	nbuilt_ = 0;
+	built_ = true;
+	attached_ = false;
+    }
+
+    void insert(K x, const V &val) { insert(x, x, val); }
+    void insert(K lo, K hi, const V &val)
+    {
+	assert(!attached_);
+	los_.push_back(lo);
+	his_.push_back(hi);
+	values_.push_back(val);
+	built_ = false;
+    }
+
+    void build();
+
+    // The arrays of a built index, each of size() elements, in
+    // the layout attach() expects.
+    const K *get_los() const { assert(built_); return plos_; }
+    const K *get_his() const { assert(built_); return phis_; }
+    const K *get_maxhis() const { assert(built_); return pmaxhis_; }
+    const V *get_values() const { assert(built_); return pvalues_; }
+
+    // Search the @n element arrays saved from a built index instead
+    // of our own.  They must stay valid while the index is used, and
+    // no more ranges can be inserted.
+    void attach(unsigned n, const K *los, const K *his,
+		const K *maxhis, const V *values)
+    {
+	clear();
+	plos_ = los;
+	phis_ = his;
+	pmaxhis_ = maxhis;
+	pvalues_ = values;
+	n_ = n;
+	attached_ = true;
+    }
+
+    // Returns the value for the range containing @x and
+    // optionally the start of that range, or 0 if none.
+    const V *find(K x, K *lop = 0) const
+    {
+	assert(built_);
+	unsigned n = n_;
+	if (!n || x < plos_[0])
+	    return 0;
+	// Find the last range starting at or before x.  The
+	// search is branchless, which matters because lookups
+	// of unrelated addresses are unpredictable.
+	const K *base = plos_;
+	while (n > 1)
+	{
+	    unsigned half = n / 2;
+	    base = (base[half] <= x ? base + half : base);
+	    n -= half;
+	}
+	unsigned i = base - plos_ + 1;
+	while (i-- > 0)
+	{
+	    if (x < phis_[i] || (x == plos_[i] && plos_[i] == phis_[i]))
+	    {
+		if (lop)
+		    *lop = plos_[i];
+		return &pvalues_[i];
+	    }
+	    // no earlier range extends as far as x
+	    if (!(x < pmaxhis_[i]))
+		break;
+	}
+	return 0;
+    }
+
+private:
+    // Sorted by lo, in parallel.  maxhis_[i] is the largest hi of
+    // ranges 0..i, which bounds the backwards search for nested ranges.
+    std::vector<K> los_;
+    std::vector<K> his_;
+    std::vector<K> maxhis_;
+    std::vector<V> values_;
+    // What find() searches: the data of the vectors above
+    // once built, or the arrays given to attach()
+    const K *plos_;
+    const K *phis_;
+    const K *pmaxhis_;
+    const V *pvalues_;
+    unsigned n_;
+    // the first nbuilt_ ranges are already sorted
+    unsigned nbuilt_;
+    bool built_;
+    bool attached_;
+};
+
+template <typename K, typename V> void
+range_index<K, V>::build()
+{
+    if (built_)
+	return;
+
+    unsigned n = los_.size();
+    std::vector<unsigned> order(n);
+    for (unsigned i = 0 ; i < n ; i++)
+	order[i] = i;
+    // sort by range, enclosing ranges before the ranges they
+    // enclose, later insertions after earlier ones
+    auto compare = [this](unsigned a, unsigned b)
+		   {
+		       return (los_[a] < los_[b] ||
+			       (los_[a] == los_[b] && his_[a] > his_[b]));
+		   };
+    // ranges from the last build() are already in order, so
+    // just sort the new ones and merge them in after any equal
+    std::stable_sort(order.begin() + nbuilt_, order.end(), compare);
+    std::inplace_merge(order.begin(), order.begin() + nbuilt_, order.end(), compare);
+
+    std::vector<K> los, his;
+    std::vector<V> values;
+    los.reserve(n);
+    his.reserve(n);
+    values.reserve(n);
+    for (unsigned i = 0 ; i < n ; i++)
+    {
+	unsigned j = order[i];
+	if (los.size() && los.back() == los_[j] && his.back() == his_[j])
+	{
+	    // the same range again, the later value wins
+	    values.back() = values_[j];
+	    continue;
+	}
+	los.push_back(los_[j]);
+	his.push_back(his_[j]);
+	values.push_back(values_[j]);
+    }
+    los_.swap(los);
+    his_.swap(his);
+    values_.swap(values);
+
+    maxhis_.resize(los_.size());
+    for (unsigned i = 0 ; i < los_.size() ; i++)
+	maxhis_[i] = (i && his_[i] < maxhis_[i-1] ? maxhis_[i-1] : his_[i]);
+
+    plos_ = los_.data();
+    phis_ = his_.data();
+    pmaxhis_ = maxhis_.data();
+    pvalues_ = values_.data();
+    n_ = los_.size();
+    nbuilt_ = los_.size();
+    built_ = true;
+}
+
+// close the namespaces
+}; };
+
+#endif // __np_util_range_index_hxx__
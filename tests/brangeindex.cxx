@@ -0,0 +1,91 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "np/util/common.hxx"
+#include "np/util/rangetree.hxx"
+#include "np/util/range_index.hxx"
+
+/*
+ * Microbenchmark for address lookups in range_index, compared
+ * against rangetree.  The ranges look like the functions in a
+ * large executable: adjacent, of varying size, with some gaps.
+ */
+
+using namespace std;
+using namespace np::util;
+
+static const unsigned NLOOKUPS = 2000000;
+
+static void
+report(const char *what, int64_t elapsed, unsigned long found)
+{
+    double ns = (double)elapsed / (double)NLOOKUPS;
+    printf("%-24s %8.2f ns/lookup  %8.2f Mlookups/sec  (found %lu)\n",
+	   what, ns, 1000.0 / ns, found);
+}
+
+static void
+bench(unsigned nranges)
+{
+    rangetree<unsigned long, unsigned> rt;
+    range_index<unsigned long, unsigned> ri;
+    unsigned seed = 42;
+    unsigned long addr = 0x400000;
+    for (unsigned i = 0 ; i < nranges ; i++)
+    {
+	unsigned long size = 16 + rand_r(&seed) % 1024;
+	rt.insert(addr, addr + size, i);
+	ri.insert(addr, addr + size, i);
+	addr += size;
+	if (!(rand_r(&seed) % 8))
+	    addr += 64;
+    }
+    ri.build();
+
+    vector<unsigned long> queries(NLOOKUPS);
+    for (unsigned i = 0 ; i < NLOOKUPS ; i++)
+	queries[i] = 0x400000 + (unsigned long)rand_r(&seed) % (addr - 0x400000);
+
+    printf("%u ranges\n", nranges);
+
+    unsigned long found = 0;
+    int64_t start = rel_now();
+    for (unsigned long q : queries)
+    {
+	rangetree<unsigned long, unsigned>::const_iterator i = rt.find(q);
+	if (i != rt.end())
+	    found += i->second;
+    }
+    report("rangetree", rel_now() - start, found);
+
+    found = 0;
+    start = rel_now();
+    for (unsigned long q : queries)
+    {
+	const unsigned *v = ri.find(q);
+	if (v)
+	    found += *v;
+    }
+    report("range_index", rel_now() - start, found);
+}
+
+int
+main(int argc __attribute__((unused)),
+     char **argv __attribute__((unused)))
+{
+    bench(1000);
+    bench(100000);
+    return 0;
+}
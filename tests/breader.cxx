@@ -0,0 +1,138 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "np/spiegel/spiegel.hxx"
+#include "np/spiegel/dwarf/reader.hxx"
+
+/*
+ * Microbenchmark for LEB128 decoding in reader_t, compared
+ * against the simple bytewise loop.  The input is a buffer of
+ * values whose encoded lengths roughly follow what's seen in
+ * .debug_info and .debug_line: mostly 1 byte, some 2 or 3 bytes,
+ * a few 5 bytes.
+ */
+
+using namespace std;
+using namespace np::util;
+
+static const unsigned NVALUES = 1000000;
+static const unsigned NPASSES = 20;
+
+static size_t
+encode_uleb128(unsigned char *p, uint32_t v)
+{
+    size_t n = 0;
+    do
+    {
+	unsigned char b = v & 0x7f;
+	v >>= 7;
+	if (v)
+	    b |= 0x80;
+	p[n++] = b;
+    } while (v);
+    return n;
+}
+
+static bool
+bytewise_read_uleb128(const unsigned char *&p, const unsigned char *end, uint32_t &v)
+{
+    const unsigned char *pp = p;
+    uint32_t vv = 0;
+    unsigned shift = 0;
+    do
+    {
+	if (pp == end)
+	    return false;
+	vv |= ((*pp) & 0x7f) << shift;
+	shift += 7;
+    } while ((*pp++) & 0x80);
+    p = pp;
+    v = vv;
+    return true;
+}
+
+static void
+report(const char *what, int64_t elapsed, uint32_t sum)
+{
+    double ns = (double)elapsed / ((double)NVALUES * NPASSES);
+    printf("%-24s %8.3f ns/value  %8.1f Mvalues/sec  (sum %u)\n",
+	   what, ns, 1000.0 / ns, sum);
+}
+
+static void
+bench(const char *name, unsigned pct1, unsigned pct2, unsigned pct3)
+{
+    unsigned char *buf = (unsigned char *)xmalloc(NVALUES * 5);
+    size_t len = 0;
+    unsigned seed = 42;
+    for (unsigned i = 0 ; i < NVALUES ; i++)
+    {
+	unsigned r = rand_r(&seed) % 100;
+	uint32_t v = rand_r(&seed);
+	if (r < pct1)
+	    v &= 0x7f;
+	else if (r < pct1 + pct2)
+	    v = (v & 0x3fff) | 0x80;
+	else if (r < pct1 + pct2 + pct3)
+	    v = (v & 0x1fffff) | 0x4000;
+	else
+	    v |= 0x80000000;
+	len += encode_uleb128(buf + len, v);
+    }
+    printf("%s: %u values in %lu bytes\n", name, NVALUES, (unsigned long)len);
+
+    uint32_t sum = 0;
+    int64_t start = rel_now();
+    for (unsigned pass = 0 ; pass < NPASSES ; pass++)
+    {
+	const unsigned char *p = buf;
+	uint32_t v;
+	while (bytewise_read_uleb128(p, buf + len, v))
+	    sum += v;
+    }
+    report("bytewise read_uleb128", rel_now() - start, sum);
+
+    sum = 0;
+    start = rel_now();
+    for (unsigned pass = 0 ; pass < NPASSES ; pass++)
+    {
+	np::spiegel::dwarf::reader_t r(buf, len);
+	uint32_t v;
+	while (r.read_uleb128(v))
+	    sum += v;
+    }
+    report("reader_t read_uleb128", rel_now() - start, sum);
+
+    sum = 0;
+    start = rel_now();
+    for (unsigned pass = 0 ; pass < NPASSES ; pass++)
+    {
+	np::spiegel::dwarf::reader_t r(buf, len);
+	while (r.skip_uleb128())
+	    sum++;
+    }
+    report("reader_t skip_uleb128", rel_now() - start, sum);
+
+    free(buf);
+}
+
+int
+main(int argc __attribute__((unused)),
+     char **argv __attribute__((unused)))
+{
+    bench("typical", 80, 15, 4);
+    bench("multibyte", 0, 50, 40);
+    return 0;
+}
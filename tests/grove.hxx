@@ -0,0 +1,36 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __novaprova_tests_grove_hxx__
+#define __novaprova_tests_grove_hxx__ 1
+
+struct kernel
+{
+    int weight;
+    char colour[12];
+};
+
+namespace grove {
+struct husk
+{
+    int thickness;
+    kernel *inside;
+    int tap() const;
+};
+};
+
+extern "C" int shuck(grove::husk h);
+
+#endif /* __novaprova_tests_grove_hxx__ */
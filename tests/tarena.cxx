@@ -0,0 +1,98 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "np/util/arena.hxx"
+#include "np/util/log.hxx"
+#include "fw.h"
+
+using namespace std;
+using namespace np::util;
+
+static bool
+is_zero(const void *p, size_t n)
+{
+    const unsigned char *c = (const unsigned char *)p;
+    while (n--)
+	if (*c++)
+	    return false;
+    return true;
+}
+
+int
+main(int argc, char **argv)
+{
+    np::util::argv0 = argv[0];
+    if (argc != 1)
+	fatal("Usage: tarena\n");
+    np::log::basic_config(np::log::DEBUG, 0);
+
+    BEGIN("arena empty");
+    arena_t a;
+    CHECK(a.get_nblocks() == 0);
+    CHECK(a.get_nallocs() == 0);
+    CHECK(a.get_nbytes() == 0);
+    END;
+
+    BEGIN("arena small");
+    arena_t a(1024);
+    char *p1 = (char *)a.alloc(3);
+    CHECK(p1 != 0);
+    CHECK(((unsigned long)p1 & 15) == 0);
+    CHECK(is_zero(p1, 3));
+    memset(p1, 0xff, 3);
+    char *p2 = (char *)a.alloc(20);
+    CHECK(p2 != 0);
+    CHECK(((unsigned long)p2 & 15) == 0);
+    CHECK(p2 == p1 + 16);
+    CHECK(is_zero(p2, 20));
+    CHECK(a.get_nblocks() == 1);
+    CHECK(a.get_nallocs() == 2);
+    CHECK(a.get_nbytes() == 48);
+    END;
+
+    BEGIN("arena many");
+    arena_t a(1024);
+    vector<unsigned *> ptrs;
+    for (unsigned i = 0 ; i < 1000 ; i++)
+    {
+	unsigned *p = (unsigned *)a.alloc(sizeof(unsigned) * 4);
+	CHECK(is_zero(p, sizeof(unsigned) * 4));
+	p[0] = i;
+	p[3] = ~i;
+	ptrs.push_back(p);
+    }
+    CHECK(a.get_nblocks() > 1);
+    for (unsigned i = 0 ; i < 1000 ; i++)
+    {
+	CHECK(ptrs[i][0] == i);
+	CHECK(ptrs[i][3] == ~i);
+    }
+    END;
+
+    BEGIN("arena large");
+    arena_t a(1024);
+    char *p1 = (char *)a.alloc(16);
+    // too big for the block size, gets its own block
+    char *p2 = (char *)a.alloc(4000);
+    CHECK(is_zero(p2, 4000));
+    CHECK(a.get_nblocks() == 2);
+    // and doesn't disturb the current block
+    char *p3 = (char *)a.alloc(16);
+    CHECK(p3 == p1 + 16);
+    CHECK(a.get_nblocks() == 2);
+    END;
+
+    return 0;
+}
@@ -219,6 +219,14 @@ main(int argc, char **argv __attribute__((unused)))
     TESTCASE(helvetica::scenester, "tdescaddr.cxx", scenester_LINE, "helvetica::scenester", 0);
     END;
 
+    BEGIN("add-self-again");
+    // link objects already read are not read again
+    size_t ncus = state.get_compile_units().size();
+    CHECK(state.add_self());
+    CHECK(state.get_compile_units().size() == ncus);
+    TESTCASE(microdosing, "tdescaddr.cxx", microdosing_LINE, "microdosing", 0);
+    END;
+
     return 0;
 }
 
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "np/spiegel/spiegel.hxx"
+#include "np/spiegel/dwarf/state.hxx"
+#include "np/spiegel/dwarf/link_object.hxx"
+#include "np/spiegel/dwarf/compile_unit.hxx"
+#include "np/spiegel/dwarf/index_file.hxx"
+#include "np/spiegel/platform/common.hxx"
+#include "fw.h"
+
+using namespace std;
+using namespace np::util;
+
+unsigned long cashew_LINE;
+
+void
+cashew(void)
+{   cashew_LINE = __LINE__;
+    fprintf(stderr, "This function exists\n");
+    fprintf(stderr, "Solely to have its address\n");
+    fprintf(stderr, "Used to lookup DWARF info.\n");
+}
+
+/* Whether the link object for the test executable was indexed
+ * from its index file rather than by walking its compile units */
+static bool
+self_has_index_file()
+{
+    np::spiegel::dwarf::state_t *ls = np::spiegel::dwarf::state_t::instance();
+    char *exe = np::spiegel::platform::self_exe();
+    np::spiegel::dwarf::link_object_t *lo = ls->get_link_object(exe);
+    free(exe);
+    return (lo && lo->has_index_file());
+}
+
+/* The lower compile unit for this file */
+static np::spiegel::dwarf::compile_unit_t *
+self_compile_unit()
+{
+    np::spiegel::dwarf::state_t *ls = np::spiegel::dwarf::state_t::instance();
+    for (np::spiegel::dwarf::compile_unit_t *cu : ls->get_compile_units())
+    {
+	if (!strcmp(cu->get_filename().basename().c_str(), "tindex.cxx"))
+	    return cu;
+    }
+    return 0;
+}
+
+#define TESTCASE(expect_index) \
+    { \
+        np::spiegel::state_t state; \
+        CHECK(state.add_self()); \
+        CHECK(self_has_index_file() == (expect_index)); \
+        np::spiegel::location_t loc; \
+        CHECK(state.describe_address((np::spiegel::addr_t)cashew+3, loc)); \
+        CHECK(loc.function_ != 0); \
+        CHECK(!strcmp(loc.function_->get_full_name().c_str(), "cashew")); \
+        CHECK(loc.line_ == cashew_LINE); \
+        CHECK(loc.offset_ == 3); \
+    }
+
+int
+main(int argc, char **argv __attribute__((unused)))
+{
+    bool debug = false;
+    if (argc == 2 && !strcmp(argv[1], "--debug"))
+    {
+        debug = true;
+    }
+    else if (argc > 1)
+    {
+        fatal("Usage: tindex [--debug]\n");
+    }
+    np::log::basic_config(debug ? np::log::DEBUG : np::log::INFO, 0);
+
+    cashew();
+    char *exe = np::spiegel::platform::self_exe();
+    string filename = np::spiegel::dwarf::index_file_t::filename_for(exe);
+    free(exe);
+    unlink(filename.c_str());
+
+    BEGIN("no-index-file");
+    TESTCASE(false);
+    END;
+
+    BEGIN("lazy-index");
+    np::spiegel::state_t state;
+    CHECK(state.add_self());
+    np::spiegel::dwarf::compile_unit_t *cu = self_compile_unit();
+    CHECK(cu != 0);
+    /* indexed on demand, as the compiler emits .debug_aranges */
+    CHECK(!cu->is_indexed());
+    np::spiegel::location_t loc;
+    CHECK(state.describe_address((np::spiegel::addr_t)cashew, loc));
+    CHECK(cu->is_indexed());
+    CHECK(loc.function_ != 0);
+    CHECK(!strcmp(loc.function_->get_full_name().c_str(), "cashew"));
+    END;
+
+    BEGIN("miss-stays-lazy");
+    np::spiegel::state_t state;
+    CHECK(state.add_self());
+    /* an address outside every link object indexes none of them */
+    char *heap = (char *)malloc(16);
+    np::spiegel::location_t loc;
+    CHECK(!state.describe_address((np::spiegel::addr_t)heap, loc));
+    free(heap);
+    np::spiegel::dwarf::compile_unit_t *cu = self_compile_unit();
+    CHECK(cu != 0);
+    CHECK(!cu->is_indexed());
+    END;
+
+    BEGIN("write-index-file");
+    np::spiegel::state_t state;
+    CHECK(state.add_self());
+    CHECK(state.write_index_files());
+    CHECK(access(filename.c_str(), R_OK) == 0);
+    END;
+
+    BEGIN("read-index-file");
+    TESTCASE(true);
+    END;
+
+    BEGIN("index-file-not-lazy");
+    np::spiegel::state_t state;
+    CHECK(state.add_self());
+    CHECK(self_has_index_file());
+    np::spiegel::dwarf::compile_unit_t *cu = self_compile_unit();
+    CHECK(cu != 0);
+    CHECK(cu->is_indexed());
+    END;
+
+    BEGIN("corrupt-index-file");
+    FILE *fp = fopen(filename.c_str(), "r+");
+    CHECK(fp != 0);
+    fseek(fp, 0, SEEK_SET);
+    fputs("GARBAGE!", fp);
+    fclose(fp);
+    TESTCASE(false);
+    END;
+
+    BEGIN("truncated-index-file");
+    CHECK(truncate(filename.c_str(), 16) == 0);
+    TESTCASE(false);
+    END;
+
+    unlink(filename.c_str());
+    return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "np/spiegel/spiegel.hxx"
+#include "np/util/log.hxx"
+#include "fw.h"
+
+/*
+ * This test is built with optimisation, so that the compiler
+ * inlines the functions below, and checks that the stack trace
+ * has a frame for each of them.
+ */
+
+using namespace std;
+using namespace np::util;
+
+static np::spiegel::state_t *state;
+static string trace;
+static volatile int sink;
+
+static inline __attribute__((always_inline)) int
+pistil(int x)
+{
+    trace = state->describe_stacktrace();
+    return x+1;
+}
+
+static inline __attribute__((always_inline)) int
+petal(int x)
+{
+    int r = pistil(x*2);
+    sink = r;
+    return r+1;
+}
+
+extern "C" __attribute__((noinline)) int
+flower(int x)
+{
+    int r = petal(x+3);
+    sink = r;
+    return r+1;
+}
+
+static bool
+frames_in_order(const char * const *names)
+{
+    size_t pos = 0;
+    for ( ; *names ; names++)
+    {
+	pos = trace.find(*names, pos);
+	if (pos == string::npos)
+	    return false;
+    }
+    return true;
+}
+
+int
+main(int argc, char **argv)
+{
+    np::util::argv0 = argv[0];
+    if (argc != 1)
+	fatal("Usage: tinline\n");
+    np::log::basic_config(np::log::INFO, 0);
+
+    state = new np::spiegel::state_t();
+    if (!state->add_self())
+	return 1;
+
+    BEGIN("inlined frames");
+    CHECK(flower(4) == 17);
+    if (is_verbose())
+	printf("%s\n", trace.c_str());
+    static const char * const names[] =
+    {
+	": pistil (", "tinline.cxx:36)",
+	": petal (", "tinline.cxx:43)",
+	": flower (", "tinline.cxx:51)",
+	": main (",
+	0
+    };
+    CHECK(frames_in_order(names));
+    END;
+
+    delete state;
+    return 0;
+}
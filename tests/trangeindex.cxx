@@ -0,0 +1,189 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "np/util/range_index.hxx"
+#include "np/util/log.hxx"
+#include "fw.h"
+
+using namespace std;
+using namespace np::util;
+
+int
+main(int argc, char **argv)
+{
+    np::util::argv0 = argv[0];
+    if (argc != 1)
+	fatal("Usage: trangeindex\n");
+    np::log::basic_config(np::log::DEBUG, 0);
+
+    BEGIN("range_index basic");
+    np::util::range_index<int, int> ri;
+    ri.build();
+    CHECK(ri.size() == 0);
+    CHECK(ri.find(40) == 0);
+    CHECK(ri.find(41) == 0);
+    END;
+
+    BEGIN("range_index one");
+    np::util::range_index<int, int> ri;
+    ri.insert(41, 43, 100041);
+    ri.build();
+    CHECK(ri.size() == 1);
+
+    int lo = 0;
+    CHECK(ri.find(40) == 0);
+    const int *v = ri.find(41, &lo);
+    CHECK(v != 0);
+    CHECK(*v == 100041);
+    CHECK(lo == 41);
+    v = ri.find(42, &lo);
+    CHECK(v != 0);
+    CHECK(*v == 100041);
+    CHECK(lo == 41);
+    CHECK(ri.find(43) == 0);
+    CHECK(ri.find(44) == 0);
+    END;
+
+    BEGIN("range_index point");
+    np::util::range_index<int, int> ri;
+    ri.insert(42, 100042);
+    ri.build();
+    CHECK(ri.find(41) == 0);
+    CHECK(ri.find(42) != 0);
+    CHECK(*ri.find(42) == 100042);
+    CHECK(ri.find(43) == 0);
+    END;
+
+    BEGIN("range_index several");
+    np::util::range_index<int, int> ri;
+    // inserted out of order, with a gap between 30 and 40
+    ri.insert(40, 50, 4);
+    ri.insert(10, 20, 1);
+    ri.insert(30, 30, 3);
+    ri.insert(20, 30, 2);
+    ri.build();
+    CHECK(ri.size() == 4);
+    CHECK(ri.find(9) == 0);
+    CHECK(*ri.find(10) == 1);
+    CHECK(*ri.find(19) == 1);
+    CHECK(*ri.find(20) == 2);
+    CHECK(*ri.find(29) == 2);
+    CHECK(*ri.find(30) == 3);
+    CHECK(ri.find(31) == 0);
+    CHECK(ri.find(39) == 0);
+    CHECK(*ri.find(40) == 4);
+    CHECK(*ri.find(49) == 4);
+    CHECK(ri.find(50) == 0);
+    END;
+
+    BEGIN("range_index duplicate");
+    np::util::range_index<int, int> ri;
+    ri.insert(10, 20, 1);
+    ri.insert(30, 40, 3);
+    ri.build();
+    // re-inserting the same range replaces the value
+    ri.insert(10, 20, 2);
+    ri.build();
+    CHECK(ri.size() == 2);
+    CHECK(*ri.find(15) == 2);
+    CHECK(*ri.find(35) == 3);
+    END;
+
+    BEGIN("range_index nested");
+    np::util::range_index<int, int> ri;
+    ri.insert(0, 100, 1);
+    ri.insert(10, 20, 2);
+    ri.insert(30, 40, 3);
+    ri.build();
+    int lo = -1;
+    CHECK(*ri.find(5, &lo) == 1);
+    CHECK(lo == 0);
+    CHECK(*ri.find(15, &lo) == 2);
+    CHECK(lo == 10);
+    CHECK(*ri.find(25, &lo) == 1);
+    CHECK(lo == 0);
+    CHECK(*ri.find(35) == 3);
+    CHECK(*ri.find(99) == 1);
+    CHECK(ri.find(100) == 0);
+    END;
+
+    BEGIN("range_index nested same start");
+    np::util::range_index<int, int> ri;
+    ri.insert(10, 20, 2);
+    ri.insert(10, 40, 1);
+    ri.insert(10, 15, 3);
+    ri.build();
+    CHECK(*ri.find(10) == 3);
+    CHECK(*ri.find(14) == 3);
+    CHECK(*ri.find(15) == 2);
+    CHECK(*ri.find(19) == 2);
+    CHECK(*ri.find(20) == 1);
+    CHECK(*ri.find(39) == 1);
+    CHECK(ri.find(40) == 0);
+    END;
+
+    BEGIN("range_index incremental");
+    np::util::range_index<int, int> ri;
+    ri.insert(10, 20, 1);
+    ri.insert(50, 60, 5);
+    ri.build();
+    // new ranges before, between, nested in and after the
+    // old ones are merged in by the next build()
+    ri.insert(70, 80, 7);
+    ri.insert(0, 5, 0);
+    ri.insert(30, 40, 3);
+    ri.insert(52, 54, 6);
+    ri.insert(10, 20, 2);
+    ri.build();
+    CHECK(ri.size() == 6);
+    CHECK(*ri.find(0) == 0);
+    CHECK(ri.find(5) == 0);
+    CHECK(*ri.find(15) == 2);
+    CHECK(*ri.find(35) == 3);
+    CHECK(*ri.find(51) == 5);
+    CHECK(*ri.find(53) == 6);
+    CHECK(*ri.find(55) == 5);
+    CHECK(*ri.find(75) == 7);
+    CHECK(ri.find(80) == 0);
+    END;
+
+    BEGIN("range_index attach");
+    np::util::range_index<int, int> ri;
+    ri.insert(0, 100, 1);
+    ri.insert(30, 40, 3);
+    ri.insert(10, 20, 2);
+    ri.build();
+    // copies of the arrays, as if saved to a file
+    unsigned n = ri.size();
+    vector<int> los(ri.get_los(), ri.get_los() + n);
+    vector<int> his(ri.get_his(), ri.get_his() + n);
+    vector<int> maxhis(ri.get_maxhis(), ri.get_maxhis() + n);
+    vector<int> values(ri.get_values(), ri.get_values() + n);
+    ri.clear();
+    np::util::range_index<int, int> ri2;
+    ri2.attach(n, los.data(), his.data(), maxhis.data(), values.data());
+    CHECK(ri2.size() == 3);
+    int lo = -1;
+    CHECK(*ri2.find(5, &lo) == 1);
+    CHECK(lo == 0);
+    CHECK(*ri2.find(15) == 2);
+    CHECK(ri2.find(15) == &values[1]);
+    CHECK(*ri2.find(25) == 1);
+    CHECK(*ri2.find(35) == 3);
+    CHECK(ri2.find(100) == 0);
+    END;
+
+    return 0;
+}
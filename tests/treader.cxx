@@ -61,5 +61,106 @@ main(int argc __attribute__((unused)),
     TESTCASE("\xb9\x64", 12857);
 
 #undef TESTCASE
+
+    /* The same again, but with enough bytes after the
+     * encoded value to trigger the word-at-a-time path. */
+#define TESTCASE(in, out) \
+    { \
+	BEGIN("read_sleb128(%d) padded", out); \
+	unsigned char buf[16]; \
+	memset(buf, 0xff, sizeof(buf)); \
+	memcpy(buf, in, sizeof(in)-1); \
+	np::spiegel::dwarf::reader_t r(buf, sizeof(buf)); \
+	int32_t v = 0; \
+	CHECK(r.read_sleb128(v)); \
+	CHECK(v == out); \
+	CHECK(r.get_offset() == sizeof(in)-1); \
+	END; \
+    }
+    TESTCASE("\x02", 2);
+    TESTCASE("\x7e", -2);
+    TESTCASE("\xff\x00", 127);
+    TESTCASE("\x81\x7f", -127);
+    TESTCASE("\x80\x01", 128);
+    TESTCASE("\x80\x7f", -128);
+    TESTCASE("\x81\x01", 129);
+    TESTCASE("\xff\x7e", -129);
+    TESTCASE("\xc0\xbb\x78", -123456);
+    TESTCASE("\xff\xff\xff\xff\x07", 2147483647);
+    TESTCASE("\x80\x80\x80\x80\x78", (int32_t)-2147483648LL);
+
+#undef TESTCASE
+#define TESTCASE(in, out) \
+    { \
+	BEGIN("read_uleb128(%u) padded", out); \
+	unsigned char buf[16]; \
+	memset(buf, 0xff, sizeof(buf)); \
+	memcpy(buf, in, sizeof(in)-1); \
+	np::spiegel::dwarf::reader_t r(buf, sizeof(buf)); \
+	uint32_t v = 0; \
+	CHECK(r.read_uleb128(v)); \
+	CHECK(v == out); \
+	CHECK(r.get_offset() == sizeof(in)-1); \
+	END; \
+    }
+
+    TESTCASE("\x02", 2);
+    TESTCASE("\x7f", 127);
+    TESTCASE("\x80\x01", 128);
+    TESTCASE("\x81\x01", 129);
+    TESTCASE("\x82\x01", 130);
+    TESTCASE("\xb9\x64", 12857);
+    TESTCASE("\xe5\x8e\x26", 624485);
+    TESTCASE("\x80\x80\x80\x80\x08", 2147483648U);
+    TESTCASE("\xff\xff\xff\xff\x0f", 4294967295U);
+
+#undef TESTCASE
+
+    BEGIN("skip_uleb128");
+    static const unsigned char buf[] =
+	"\x02\x80\x01\xe5\x8e\x26\xff\xff\xff\xff\x0f"
+	"\x81\x80\x80\x80\x80\x80\x80\x80\x00\x7f";
+    np::spiegel::dwarf::reader_t r(buf, sizeof(buf)-1);
+    CHECK(r.skip_uleb128());
+    CHECK(r.get_offset() == 1);
+    CHECK(r.skip_uleb128());
+    CHECK(r.get_offset() == 3);
+    CHECK(r.skip_uleb128());
+    CHECK(r.get_offset() == 6);
+    CHECK(r.skip_sleb128());
+    CHECK(r.get_offset() == 11);
+    // longer than a word
+    CHECK(r.skip_uleb128());
+    CHECK(r.get_offset() == 20);
+    // last byte in the buffer
+    CHECK(r.skip_sleb128());
+    CHECK(r.get_offset() == 21);
+    CHECK(!r.skip_uleb128());
+    END;
+
+    BEGIN("read_uleb128 truncated");
+    static const unsigned char buf[] = "\x81\x82\x83";
+    np::spiegel::dwarf::reader_t r(buf, sizeof(buf)-1);
+    uint32_t v = 0;
+    CHECK(!r.read_uleb128(v));
+    CHECK(r.get_offset() == 0);
+    END;
+
+    BEGIN("read_uleb128 sequence");
+    // enough values that some are decoded a word at a time
+    // and the ones near the end of the buffer are not
+    static const unsigned char buf[] =
+	"\x01\x80\x01\xb9\x64\x7f\xe5\x8e\x26\x00\x82\x01";
+    static const uint32_t expected[] = { 1, 128, 12857, 127, 624485, 0, 130 };
+    np::spiegel::dwarf::reader_t r(buf, sizeof(buf)-1);
+    for (unsigned i = 0 ; i < sizeof(expected)/sizeof(expected[0]) ; i++)
+    {
+	uint32_t v = 0;
+	CHECK(r.read_uleb128(v));
+	CHECK(v == expected[i]);
+    }
+    CHECK(r.get_remains() == 0);
+    END;
+
     return 0;
 }
@@ -21,11 +21,13 @@ using namespace std;
 using namespace np::util;
 
 static np::spiegel::state_t *state;
+static string last_trace;
 
 int vegan(int x)
 {
     string trace = state->describe_stacktrace();
     printf("Stacktrace: \n%s\n", trace.c_str());
+    last_trace = trace;
     return x/2;
 }
 
@@ -68,7 +70,25 @@ main(int argc, char **argv)
     if (!state->add_self())
 	return 1;
 
-    leggings::dreamcatcher(42);
+    // the second trace should come entirely from the location cache
+    string traces[2];
+    unsigned long hits[2], misses[2];
+    for (int i = 0 ; i < 2 ; i++)
+    {
+	leggings::dreamcatcher(42);
+	traces[i] = last_trace;
+	state->get_location_cache_stats(hits[i], misses[i]);
+	printf("Location cache: %lu hits %lu misses\n", hits[i], misses[i]);
+    }
+    if (traces[0] != traces[1])
+	fatal("Stack traces differ\n");
+    // every frame of the first trace was looked up once
+    unsigned long nframes = hits[0] + misses[0];
+    if (!nframes)
+	fatal("Expecting the first stack trace to look up its frames\n");
+    if (misses[1] != misses[0] || hits[1] - hits[0] != nframes)
+	fatal("Expecting the second stack trace to hit the cache "
+	      "for all %lu frames\n", nframes);
 
     return 0;
 }
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "np/spiegel/spiegel.hxx"
+#include "np/util/log.hxx"
+#include "np/util/filename.hxx"
+#include "fw.h"
+
+/*
+ * Checks that function names and line numbers are found for a
+ * stack trace.  This source is built as several tests, each with
+ * the debug information in a different form:
+ *
+ * tcompressed	with compressed debug sections
+ * tsplit	with split DWARF, mostly in a .dwo file
+ * tdebuglink	stripped, with the debug information moved into a
+ *		separate file the way distros ship -dbg packages,
+ *		found via .gnu_debuglink
+ * tbuildid	likewise, but found by build-id in a debug directory
+ *		named by $NOVAPROVA_DEBUG_DIR
+ */
+
+using namespace std;
+using namespace np::util;
+
+#define capture_line(nm) \
+    (nm) = __LINE__
+
+static np::spiegel::state_t *state;
+static string trace;
+unsigned long walnut_LINE;
+unsigned long chestnut_LINE;
+
+extern "C" __attribute__((noinline)) int
+walnut(int x)
+{
+    trace = state->describe_stacktrace(); capture_line(walnut_LINE);
+    return x+1;
+}
+
+extern "C" __attribute__((noinline)) int
+chestnut(int x)
+{
+    int r = walnut(x*2); capture_line(chestnut_LINE);
+    return r+1;
+}
+
+static bool
+frames_in_order(const vector<string> &names)
+{
+    size_t pos = 0;
+    for (const string &name : names)
+    {
+	pos = trace.find(name, pos);
+	if (pos == string::npos)
+	    return false;
+    }
+    return true;
+}
+
+static string
+source_line(unsigned long line)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "ttrace.cxx:%lu)", line);
+    return buf;
+}
+
+int
+main(int argc, char **argv)
+{
+    np::util::argv0 = argv[0];
+    if (argc != 1)
+	fatal("Usage: %s\n", argv0);
+    np::log::basic_config(np::log::INFO, 0);
+
+#if TEST_BUILDID
+    string debugdir = filename_t("debug").make_absolute();
+    setenv("NOVAPROVA_DEBUG_DIR", debugdir.c_str(), 1);
+#endif
+
+    state = new np::spiegel::state_t();
+    if (!state->add_self())
+	return 1;
+
+    BEGIN("stack trace");
+    CHECK(chestnut(4) == 10);
+    if (is_verbose())
+	printf("%s\n", trace.c_str());
+    vector<string> names;
+    names.push_back(": walnut (");
+    names.push_back(source_line(walnut_LINE));
+    names.push_back(": chestnut (");
+    names.push_back(source_line(chestnut_LINE));
+    names.push_back(": main (");
+    CHECK(frames_in_order(names));
+    END;
+
+    delete state;
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "np/spiegel/spiegel.hxx"
+#include "np/spiegel/dwarf/state.hxx"
+#include "np/spiegel/dwarf/walker.hxx"
+#include "np/spiegel/platform/abi.h"
+#include "np/util/log.hxx"
+#include "fw.h"
+#include "grove.hxx"
+
+/*
+ * This test is built with -fdebug-types-section, so the structs
+ * below are described in DWARF 4 type units and referred to from
+ * the compile unit by type signature.  It checks that the types
+ * of function parameters are still described correctly, and that
+ * a type is the same whether it's reached by signature, as from
+ * grove.cxx, or via the declaration this compile unit has for it
+ * because it defines a member function.
+ */
+
+using namespace std;
+using namespace np::util;
+
+unsigned long tap_PC;
+
+int
+grove::husk::tap() const
+{
+    capture_pc(tap_PC);
+    return thickness;
+}
+
+extern "C" __attribute__((noinline)) int
+crack(grove::husk *h, kernel k)
+{
+    return h->tap() + k.weight;
+}
+
+extern "C" __attribute__((noinline)) int
+peel(grove::husk h)
+{
+    return h.tap();
+}
+
+static np::spiegel::function_t *
+find_function(np::spiegel::state_t *state, const char *filename, const char *name)
+{
+    for (np::spiegel::compile_unit_t *cu : state->get_compile_units())
+    {
+	if (strcmp(cu->get_filename().basename().c_str(), filename))
+	    continue;
+	for (np::spiegel::function_t *fn : cu->get_functions())
+	{
+	    if (fn->get_name() == name)
+		return fn;
+	}
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    np::util::argv0 = argv[0];
+    if (argc != 1)
+	fatal("Usage: ttypeunits\n");
+    np::log::basic_config(np::log::INFO, 0);
+
+    grove::husk h = { 3, 0 };
+    if (peel(h) != shuck(h))
+	return 1;
+
+    np::spiegel::state_t *state = new np::spiegel::state_t();
+    if (!state->add_self())
+	return 1;
+
+    BEGIN("type units");
+    np::spiegel::function_t *fn = find_function(state, "ttypeunits.cxx", "crack");
+    CHECK(fn != 0);
+    if (is_verbose())
+	printf("%s\n", fn->to_string().c_str());
+    CHECK(fn->to_string() == "int crack(struct husk *h, struct kernel k)");
+
+    vector<np::spiegel::type_t*> params = fn->get_parameter_types();
+    CHECK(params.size() == 2);
+    CHECK(params[1]->get_classification() == np::spiegel::type_t::TC_STRUCT);
+    CHECK(params[1]->get_sizeof() == sizeof(kernel));
+    CHECK(params[1]->get_name() == "kernel");
+    END;
+
+    BEGIN("type shared between compile units");
+    /* here grove::husk is referred to via its declaration... */
+    np::spiegel::function_t *fn = find_function(state, "ttypeunits.cxx", "peel");
+    CHECK(fn != 0);
+    vector<np::spiegel::type_t*> params = fn->get_parameter_types();
+    CHECK(params.size() == 1);
+    /* ...and in grove.cxx directly by signature */
+    np::spiegel::function_t *fn2 = find_function(state, "grove.cxx", "shuck");
+    CHECK(fn2 != 0);
+    vector<np::spiegel::type_t*> params2 = fn2->get_parameter_types();
+    CHECK(params2.size() == 1);
+    /* both are the type unit's definition, as one type_t */
+    CHECK(params[0] == params2[0]);
+    CHECK(params[0]->get_classification() == np::spiegel::type_t::TC_STRUCT);
+    CHECK(params[0]->get_sizeof() == sizeof(grove::husk));
+    CHECK(params[0]->get_name() == "husk");
+    END;
+
+    BEGIN("member function class");
+    np::spiegel::location_t loc;
+    CHECK(state->describe_address(tap_PC, loc));
+    np::spiegel::function_t *fn = loc.function_;
+    CHECK(fn != 0);
+    CHECK(fn->get_full_name() == "grove::husk::tap");
+    /* tap() is declared in this compile unit's declaration of
+     * its class, whose signature leads to the type unit */
+    np::spiegel::dwarf::walker_t w(fn->ref());
+    const np::spiegel::dwarf::entry_t *e = w.move_next();
+    CHECK(e != 0);
+    CHECK(e->get_attribute(DW_AT_specification));
+    e = w.move_to(e->get_reference_attribute(DW_AT_specification));
+    CHECK(e != 0);
+    e = w.move_up();
+    CHECK(e != 0);
+    CHECK(e->get_tag() == DW_TAG_structure_type);
+    CHECK(e->get_attribute(DW_AT_declaration));
+    np::spiegel::dwarf::reference_t sigref = e->get_reference_attribute(DW_AT_signature);
+    CHECK(!(sigref == np::spiegel::dwarf::reference_t::null));
+    vector<np::spiegel::type_t*> params = find_function(state, "grove.cxx", "shuck")->get_parameter_types();
+    CHECK(params[0]->ref() == sigref);
+    END;
+
+    delete state;
+    return 0;
+}
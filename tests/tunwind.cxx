@@ -0,0 +1,92 @@
+/*
+ * Copyright 2011-2020 Gregory Banks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "np/spiegel/spiegel.hxx"
+#include "np/util/log.hxx"
+#include "fw.h"
+
+/*
+ * This test is built with -fomit-frame-pointer, so the
+ * stack trace can only get past the functions below by
+ * unwinding with the Call Frame Information.
+ */
+
+using namespace std;
+using namespace np::util;
+
+static np::spiegel::state_t *state;
+static string trace;
+static volatile int sink;
+
+extern "C" __attribute__((noinline)) int
+leaf(int x)
+{
+    /* Make sure that stale frame pointers can't
+     * accidentally lead back to our callers */
+#if defined(_NP_x86_64)
+    __asm__ volatile("xorq %%rbp, %%rbp" : : : "rbp");
+#else
+    __asm__ volatile("xorl %%ebp, %%ebp" : : : "ebp");
+#endif
+    trace = state->describe_stacktrace();
+    return x+1;
+}
+
+extern "C" __attribute__((noinline)) int
+twig(int x)
+{
+    /* locals which the compiler must keep on
+     * the stack, to make a non-trivial frame */
+    volatile int buf[37];
+    for (int i = 0 ; i < 37 ; i++)
+	buf[i] = x + i;
+    int r = leaf(buf[x % 37]);
+    sink = buf[3];
+    return r+1;
+}
+
+extern "C" __attribute__((noinline)) int
+branch(int x)
+{
+    int r = twig(x*2);
+    sink = r;
+    return r+1;
+}
+
+int
+main(int argc, char **argv)
+{
+    np::util::argv0 = argv[0];
+    if (argc != 1)
+	fatal("Usage: tunwind\n");
+    np::log::basic_config(np::log::INFO, 0);
+
+    state = new np::spiegel::state_t();
+    if (!state->add_self())
+	return 1;
+
+    BEGIN("unwind without frame pointers");
+    CHECK(branch(7) == 31);
+    if (is_verbose())
+	printf("%s\n", trace.c_str());
+    CHECK(trace.find("leaf") != string::npos);
+    CHECK(trace.find("twig") != string::npos);
+    CHECK(trace.find("branch") != string::npos);
+    CHECK(trace.find("main") != string::npos);
+    END;
+
+    delete state;
+    return 0;
+}